@@ -0,0 +1,285 @@
+/** @file       bench.c
+ *  @brief      Micro benchmarks for the hot spots of the simulator
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com
+ *
+ * Results are printed as comma separated key/value pairs like the headless
+ * mode output so they can be compared between builds and machines. Times
+ * are CPU time as measured by clock(). */
+#include "bench.h"
+#include "brain.h"
+#include "rank.h"
+#include "sexpr.h"
+#include "util.h"
+#include "vars.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static volatile size_t sink; /* stops draws being optimized away */
+
+static double now(void) {
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+/* The roulette wheel as it used to be; a linear scan of cumulative weights */
+static size_t spin_wheel(const double *wheel, size_t count) {
+	const double r = random_float();
+	size_t i = 0;
+	for (i = 0; i < count - 1; i++)
+		if (wheel[i] >= r)
+			break;
+	return i;
+}
+
+static int report(FILE *out, const char *method, size_t population, double build, double draw, size_t draws) {
+	const double per_draw = draw / draws;
+	return fprintf(out, "selection, %-10s, population, %6zu, build-ms, %9.3f, draw-ns, %9.2f, generation-ms, %10.3f\n",
+			method, population, build * 1e3, per_draw * 1e9, (build + (per_draw * 2 * population)) * 1e3);
+}
+
+/* Each generation needs up to two draws per child, the linear scan is only
+ * timed over a limited number of draws as it is quadratic overall. */
+static int benchmark_selection(FILE *out) {
+	int r = 0;
+	for (size_t population = 1000; population <= 100000; population *= 10) {
+		double *weights = allocate(sizeof(weights[0]) * population);
+		double *wheel   = allocate(sizeof(wheel[0]) * population);
+		const size_t draws = 2 * population, linear_draws = MIN(draws, 20000u);
+		double total = 0;
+		for (size_t i = 0; i < population; i++)
+			total += (weights[i] = random_float());
+
+		double t = now();
+		wheel[0] = weights[0] / total;
+		for (size_t i = 1; i < population; i++)
+			wheel[i] = wheel[i-1] + (weights[i] / total);
+		const double linear_build = now() - t;
+		t = now();
+		for (size_t i = 0; i < linear_draws; i++)
+			sink += spin_wheel(wheel, population);
+		if (report(out, "linear", population, linear_build, now() - t, linear_draws) < 0)
+			r = -1;
+
+		t = now();
+		alias_t *a = alias_new(weights, population);
+		const double alias_build = now() - t;
+		t = now();
+		for (size_t i = 0; i < draws; i++)
+			sink += alias_sample(a);
+		if (report(out, "alias", population, alias_build, now() - t, draws) < 0)
+			r = -1;
+		alias_delete(a);
+
+		t = now();
+		for (size_t i = 0; i < draws; i++)
+			sink += tournament_sample(weights, population, selection_tournament_size);
+		if (report(out, "tournament", population, 0, now() - t, draws) < 0)
+			r = -1;
+
+		free(weights);
+		free(wheel);
+	}
+	return r;
+}
+
+static int compare(const void *a, const void *b) {
+	const double fa = ((const rank_t*)a)->key, fb = ((const rank_t*)b)->key;
+	if (fa > fb)
+		return -1;
+	return fa < fb;
+}
+
+/* A full sort of the keys compared with only picking out the best few, as
+ * is needed to find the winners or a champion */
+static int benchmark_ranking(FILE *out) {
+	int r = 0;
+	for (size_t population = 1000; population <= 100000; population *= 10) {
+		double *keys = allocate(sizeof(keys[0]) * population);
+		rank_t *ranks = allocate(sizeof(ranks[0]) * population);
+		for (size_t i = 0; i < population; i++)
+			keys[i] = random_float();
+		const size_t tops[] = { 1, population / 10, population };
+		for (size_t i = 0; i < sizeof(tops)/sizeof(tops[0]); i++) {
+			rank_fill(ranks, keys, population);
+			double t = now();
+			rank_top(ranks, population, tops[i]);
+			const double partial = now() - t;
+			sink += ranks[0].index;
+			rank_fill(ranks, keys, population);
+			t = now();
+			qsort(ranks, population, sizeof(ranks[0]), compare);
+			const double full = now() - t;
+			sink += ranks[0].index;
+			if (fprintf(out, "ranking, population, %6zu, top, %6zu, rank-top-ms, %9.3f, qsort-ms, %9.3f\n",
+					population, tops[i], partial * 1e3, full * 1e3) < 0)
+				r = -1;
+		}
+		free(keys);
+		free(ranks);
+	}
+	return r;
+}
+
+#define BENCHMARK_FILE ("gladiator.bench.lsp")
+
+static int reader_report(FILE *out, const char *reader, double megabytes, double t, size_t elements) {
+	return fprintf(out, "s-expression, reader, %-10s, megabytes, %6.2f, elements, %5zu, ms, %9.3f, megabytes-per-second, %7.2f\n",
+			reader, megabytes, elements, t * 1e3, megabytes / t);
+}
+
+/* Times the reading of the file and the freeing of what was read */
+static int reader_run(FILE *out, const char *reader, double megabytes, bool buffered, bool mapped, bool arena) {
+	FILE *f = NULL;
+	if (!mapped && !(f = fopen(BENCHMARK_FILE, "rb")))
+		return -1;
+	if (f && !buffered)
+		setvbuf(f, NULL, _IONBF, 0);
+	cell_arena_t *a = arena ? cell_arena_new() : NULL;
+	const double t = now();
+	cell_t *c = mapped ? read_s_expression_from_path(BENCHMARK_FILE, a) : read_s_expression_from_file_arena(f, a);
+	const size_t elements = c ? cell_length(c) : 0;
+	cell_delete(c);
+	cell_arena_delete(a);
+	const double elapsed = now() - t;
+	if (f)
+		fclose(f);
+	return reader_report(out, reader, megabytes, elapsed, elements) < 0 || !elements ? -1 : 0;
+}
+
+/* Every brain read back from the file must have exactly the same genome as
+ * the one written out, down to the last bit of every weight. */
+static int round_trip(FILE *out, brain_t **brains, size_t population) {
+	cell_arena_t *a = cell_arena_new();
+	cell_t *c = read_s_expression_from_path(BENCHMARK_FILE, a);
+	const size_t length = brain_genome_length(brains[0]);
+	double *expected = allocate(sizeof(expected[0]) * length);
+	double *actual   = allocate(sizeof(actual[0]) * length);
+	size_t exact = 0, i = 0;
+	for (cell_t *l = c ? cdr(c) : NULL; l && type(l) == CONS && i < population; l = cdr(l), i++) {
+		brain_t *b = brain_deserialize(car(l));
+		if (!b)
+			break;
+		brain_genome_export(brains[i], expected);
+		brain_genome_export(b, actual);
+		exact += !memcmp(expected, actual, sizeof(expected[0]) * length);
+		brain_delete(b);
+	}
+	free(expected);
+	free(actual);
+	cell_arena_delete(a);
+	if (fprintf(out, "s-expression, round-trip, brains, %5zu, exact, %5zu\n", population, exact) < 0)
+		return -1;
+	if (exact != population) {
+		warning("%zu of %zu brains did not read back exactly", population - exact, population);
+		return -1;
+	}
+	return 0;
+}
+
+/* Streams a population of brains out in the format used to save the world
+ * then reads it back; a character at a time from an unbuffered stream as
+ * the world used to be loaded, from a buffered stream, from a mapped file
+ * and from a mapped file into an arena. The brains read back must match
+ * the ones written out exactly. */
+static int benchmark_s_expression(FILE *out) {
+	static const size_t population = 1024;
+	FILE *f = fopen(BENCHMARK_FILE, "wb");
+	if (!f)
+		return -1;
+	brain_t **brains = allocate(sizeof(brains[0]) * population);
+	for (size_t i = 0; i < population; i++)
+		brains[i] = brain_new(true, true, gladiator_brain_length, gladiator_brain_depth);
+	const double t = now();
+	emitter_t *e = emitter_new(f);
+	emit_begin(e);
+	emit_symbol(e, "brains");
+	for (size_t i = 0; i < population; i++)
+		brain_serialize(brains[i], e);
+	emit_end(e);
+	const long bytes = emitter_delete(e);
+	const int closed = fclose(f);
+	const double elapsed = now() - t, megabytes = bytes / (1024.0 * 1024.0);
+	int r = -1;
+	if (closed < 0 || bytes < 0)
+		goto done;
+	if (fprintf(out, "s-expression, writer, %-10s, megabytes, %6.2f, elements, %5zu, ms, %9.3f, megabytes-per-second, %7.2f\n",
+			"stream", megabytes, population + 1, elapsed * 1e3, megabytes / elapsed) < 0)
+		goto done;
+	r = 0;
+	r |= reader_run(out, "unbuffered", megabytes, false, false, false);
+	r |= reader_run(out, "buffered",   megabytes, true,  false, false);
+	r |= reader_run(out, "mapped",     megabytes, true,  true,  false);
+	r |= reader_run(out, "arena",      megabytes, true,  true,  true);
+	r |= round_trip(out, brains, population);
+done:
+	for (size_t i = 0; i < population; i++)
+		brain_delete(brains[i]);
+	free(brains);
+	remove(BENCHMARK_FILE);
+	return r < 0 ? -1 : 0;
+}
+
+#define FLOATS (1u << 20)
+
+static int float_report(FILE *out, const char *method, double t, size_t bytes) {
+	return fprintf(out, "float, %-10s, numbers, %7u, ns-per-number, %7.2f, bytes-per-number, %5.2f\n",
+			method, FLOATS, t * 1e9 / FLOATS, (double)bytes / FLOATS);
+}
+
+/* Numbers like the weights of a brain are formatted with 'printf' at the
+ * old fixed precision, which loses most of each number, at the precision
+ * 'printf' needs to always round trip and at the shortest precision that
+ * does, then parsed back with 'strtod' and with 'float_parse'. */
+static int benchmark_float(FILE *out) {
+	double *numbers = allocate(sizeof(numbers[0]) * FLOATS);
+	char *text = allocate(FLOATS * FLOAT_FORMAT_MAX);
+	for (size_t i = 0; i < FLOATS; i++)
+		numbers[i] = (random_float() * 2.0) - 1.0;
+	int r = 0;
+	static const char *formats[] = { "%.5f", "%.17g" };
+	for (size_t j = 0; j < sizeof(formats)/sizeof(formats[0]); j++) {
+		size_t bytes = 0;
+		const double t = now();
+		for (size_t i = 0; i < FLOATS; i++)
+			bytes += snprintf(text + (i * FLOAT_FORMAT_MAX), FLOAT_FORMAT_MAX, formats[j], numbers[i]);
+		if (float_report(out, formats[j], now() - t, bytes) < 0)
+			r = -1;
+	}
+	size_t bytes = 0;
+	double t = now();
+	for (size_t i = 0; i < FLOATS; i++)
+		bytes += float_format(text + (i * FLOAT_FORMAT_MAX), numbers[i]);
+	if (float_report(out, "shortest", now() - t, bytes) < 0)
+		r = -1;
+
+	size_t exact = 0;
+	t = now();
+	for (size_t i = 0; i < FLOATS; i++)
+		exact += strtod(text + (i * FLOAT_FORMAT_MAX), NULL) == numbers[i];
+	if (float_report(out, "strtod", now() - t, bytes) < 0 || exact != FLOATS)
+		r = -1;
+	exact = 0;
+	t = now();
+	for (size_t i = 0; i < FLOATS; i++) {
+		const char *s = text + (i * FLOAT_FORMAT_MAX);
+		double x = 0;
+		exact += float_parse(s, strlen(s), &x) == 0 && x == numbers[i];
+	}
+	if (float_report(out, "parse", now() - t, bytes) < 0 || exact != FLOATS)
+		r = -1;
+	free(text);
+	free(numbers);
+	return r;
+}
+
+int benchmark(FILE *out) {
+	assert(out);
+	const int r1 = benchmark_selection(out);
+	const int r2 = benchmark_ranking(out);
+	const int r3 = benchmark_s_expression(out);
+	const int r4 = benchmark_float(out);
+	return r1 < 0 || r2 < 0 || r3 < 0 || r4 < 0 ? -1 : 0;
+}
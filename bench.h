@@ -0,0 +1,14 @@
+/** @file       bench.h
+ *  @brief      Micro benchmarks for the hot spots of the simulator
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+
+int benchmark(FILE *out);
+
+#endif
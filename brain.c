@@ -10,6 +10,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* It might have been better to use fixed point arithmetic instead
  * of floating point as it would make things far more deterministic,
@@ -18,32 +19,41 @@
  * might be faster, it also might not be.
  *
  * Speeding up the brain would drastically speed up simulation as
- * well. */
-typedef struct {
-	size_t weight_count;
-	unsigned mutations;
-	double bias;
-	double retro_weight;
-	double *retro;
-	double state;
-	double state_weight;
-	double state_forget;
-	double state_accum;
-	double state_init;
-	double weights[];
-} neuron_t;
+ * well.
+ *
+ * The parameters of a brain, its genome, are kept in a single reference
+ * counted block which copies of a brain share until one of them changes a
+ * parameter, the run time state (neuron state, layer outputs and the
+ * feedback wiring) belongs to each brain. Within the block each neuron is a
+ * row of NEURON_WEIGHTS parameters followed by its weights, rows are stored
+ * neuron by neuron and layer by layer. The reference count is atomic as
+ * the children of a generation, which share genes with their parents, are
+ * built on several threads at once. */
+enum {
+	NEURON_BIAS,
+	NEURON_RETRO,
+	NEURON_STATE_WEIGHT,
+	NEURON_STATE_FORGET,
+	NEURON_STATE_ACCUM,
+	NEURON_STATE_INIT,
+	NEURON_WEIGHTS, /* number of parameters before the weights */
+};
 
 typedef struct {
-	size_t length;
-	neuron_t **neurons;
-	double *outputs;
-} layer_t;
+	unsigned references;
+	size_t count;         /* number of parameters */
+	unsigned *mutations;  /* per neuron, stored after the parameters */
+	double parameters[];
+} genes_t;
 
 struct brain_t {
 	size_t length;
 	size_t depth;
-	double  *inputs;
-	layer_t **layers;
+	genes_t *genes;
+	double *inputs;
+	double *outputs;   /* depth * length */
+	double *state;     /* depth * length */
+	double **retro;    /* per layer, the outputs fed back into it, if any */
 };
 
 typedef enum {
@@ -60,68 +70,69 @@ static double randomer(double original) {
 	return r + original;
 }
 
-static neuron_t *neuron_new(bool rand, size_t length) {
-	neuron_t *n = allocate(sizeof(*n) + sizeof(n->weights[0])*length);
-	n->bias         = rand ? randomer(n->bias)         : 1.0;
-	if (n->retro)
-		n->retro_weight = rand ? randomer(n->retro_weight) : 1.0;
-	if (brain_internal_state_is_on) {
-		n->state_weight = rand ? randomer(n->state_weight) : 1.0;
-		n->state_forget = rand ? randomer(n->state_forget) : 1.0;
-		n->state_accum  = rand ? randomer(n->state_accum)  : 1.0;
-		n->state_init   = rand ? randomer(n->state_init)   : 1.0;
-		n->state        = n->state_init;
-	}
-	n->weight_count = length;
-	for (size_t i = 0; i < length; i++)
-		n->weights[i] = rand ? randomer(n->weights[i]) : 1.0;
+static size_t row_length(size_t length) {
+	return NEURON_WEIGHTS + length;
+}
+
+static genes_t *genes_new(size_t length, size_t depth) {
+	const size_t count = depth * length * row_length(length);
+	genes_t *g = allocate(sizeof(*g) + (sizeof(g->parameters[0]) * count) + (sizeof(g->mutations[0]) * depth * length));
+	g->references = 1;
+	g->count = count;
+	g->mutations = (unsigned*)&g->parameters[count];
+	return g;
+}
+
+static genes_t *genes_copy(const genes_t *g, size_t length, size_t depth) {
+	genes_t *n = genes_new(length, depth);
+	memcpy(n->parameters, g->parameters, sizeof(g->parameters[0]) * g->count);
+	memcpy(n->mutations, g->mutations, sizeof(g->mutations[0]) * depth * length);
 	return n;
 }
 
-static void neuron_delete(neuron_t *n) {
-	free(n);
+static void genes_release(genes_t *g) {
+	if (g && !__atomic_sub_fetch(&g->references, 1, __ATOMIC_ACQ_REL))
+		free(g);
 }
 
-static layer_t *layer_new(bool alloc_neurons, bool rand, size_t length) {
-	layer_t *l = allocate(sizeof(*l));
-	l->length  = length;
-	l->outputs = allocate(sizeof(l->outputs[0]) * length);
-	l->neurons = allocate(sizeof(l->neurons[0]) * length);
-	for (size_t i = 0; alloc_neurons && i < length; i++)
-		l->neurons[i] = neuron_new(rand, length);
-	return l;
+static double *neuron(const brain_t *b, size_t layer, size_t i) {
+	assert(layer < b->depth && i < b->length);
+	return &b->genes->parameters[((layer * b->length) + i) * row_length(b->length)];
 }
 
-static void layer_delete(layer_t *l) {
-	if (!l)
+/* Must be called before any parameter is changed, if the parameters are
+ * shared with another brain this brain gets its own copy of them */
+static void genes_unshare(brain_t *b) {
+	assert(b && b->genes);
+	if (__atomic_load_n(&b->genes->references, __ATOMIC_ACQUIRE) == 1)
 		return;
-	if (l->neurons)
-		for (size_t i = 0; i < l->length; i++)
-			neuron_delete(l->neurons[i]);
-	free(l->neurons);
-	free(l->outputs);
-	free(l);
-}
-
-static void neuron_copy_over(neuron_t *dst, const neuron_t *src) {
-	assert(dst && src);
-	dst->bias         = src->bias;
-	dst->weight_count = src->weight_count;
-	dst->retro_weight = src->retro_weight;
-	dst->state_weight = src->state_weight;
-	dst->state_forget = src->state_forget;
-	dst->state_accum  = src->state_accum;
-	dst->state_init   = src->state_init;
-	dst->mutations    = src->mutations;
-	for (size_t i = 0; i < src->weight_count; i++)
-		dst->weights[i] = src->weights[i];
-}
-
-static layer_t *layer_copy(layer_t *l) {
-	layer_t *n = layer_new(true, false, l->length);
-	for (size_t i = 0; i < l->length; i++)
-		neuron_copy_over(n->neurons[i], l->neurons[i]);
-	return n;
+	genes_t *g = genes_copy(b->genes, b->length, b->depth);
+	genes_release(b->genes);
+	b->genes = g;
+}
+
+static void neuron_randomize(double *n, bool rand, size_t length) {
+	n[NEURON_BIAS] = rand ? randomer(0.0) : 1.0;
+	/* the retro weight has never been randomized and starts at zero */
+	if (brain_internal_state_is_on) {
+		n[NEURON_STATE_WEIGHT] = rand ? randomer(0.0) : 1.0;
+		n[NEURON_STATE_FORGET] = rand ? randomer(0.0) : 1.0;
+		n[NEURON_STATE_ACCUM]  = rand ? randomer(0.0) : 1.0;
+		n[NEURON_STATE_INIT]   = rand ? randomer(0.0) : 1.0;
+	}
+	for (size_t i = 0; i < length; i++)
+		n[NEURON_WEIGHTS + i] = rand ? randomer(0.0) : 1.0;
+}
+
+/* Clears the run time state, leaving the brain as it would be if it were
+ * freshly created with its parameters */
+static void brain_reset(brain_t *b) {
+	assert(b);
+	for (size_t i = 0; i < b->depth; i++)
+		for (size_t j = 0; j < b->length; j++) {
+			b->state[(i * b->length) + j] = neuron(b, i, j)[NEURON_STATE_INIT];
+			b->outputs[(i * b->length) + j] = 0.0;
+		}
 }
 
 static double mutation(double original, size_t length, unsigned *count) {
@@ -134,105 +145,131 @@ static double mutation(double original, size_t length, unsigned *count) {
 	return original;
 }
 
-static void neuron_mutate(neuron_t *n, size_t depth, unsigned *count) {
-	assert(n && count);
-	const size_t length = n->weight_count * depth;
-	unsigned *muts = &n->mutations;
-	n->bias = mutation(n->bias, length, muts);
-	if (n->retro)
-		n->retro_weight = mutation(n->bias, length, muts);
+/* Parameters are only written to if they change, so that a brain that
+ * escapes mutation keeps sharing its parameters */
+static void mutate(brain_t *b, size_t layer, size_t i, size_t parameter, size_t length) {
+	double *n = neuron(b, layer, i);
+	unsigned muts = 0;
+	const double v = mutation(n[parameter], length, &muts);
+	if (!muts)
+		return;
+	genes_unshare(b);
+	neuron(b, layer, i)[parameter] = v;
+	b->genes->mutations[(layer * b->length) + i] += muts;
+}
+
+static unsigned neuron_mutate(brain_t *b, size_t layer, size_t i) {
+	assert(b);
+	const size_t length = b->length * b->depth;
+	mutate(b, layer, i, NEURON_BIAS, length);
+	if (b->retro[layer])
+		mutate(b, layer, i, NEURON_RETRO, length);
 	if (brain_internal_state_is_on) {
-		n->state_weight = mutation(n->state_weight, length, muts);
-		n->state_forget = mutation(n->state_forget, length, muts);
-		n->state_accum  = mutation(n->state_accum,  length, muts);
-		n->state_init   = mutation(n->state_init,   length, muts);
+		mutate(b, layer, i, NEURON_STATE_WEIGHT, length);
+		mutate(b, layer, i, NEURON_STATE_FORGET, length);
+		mutate(b, layer, i, NEURON_STATE_ACCUM,  length);
+		mutate(b, layer, i, NEURON_STATE_INIT,   length);
 	}
-	for (size_t i = 0; i < n->weight_count; i++)
-		n->weights[i] = mutation(n->weights[i], length, muts);
-	*count = n->mutations;
+	for (size_t j = 0; j < b->length; j++)
+		mutate(b, layer, i, NEURON_WEIGHTS + j, length);
+	return b->genes->mutations[(layer * b->length) + i];
 }
 
-static cell_t *neuron_serialize(neuron_t *n) {
-	cell_t *head = cons(mksym("weights"), nil());
-	cell_t *op = head;
-	for (size_t i = 0; i < n->weight_count; op = cdr(op), i++)
-		setcdr(op, cons(mkfloat(n->weights[i]), nil()));
-	cell_t *r = printer("neuron %x (bias %f) (mutations %d) (retro %f) (state %f %f %f %f)", 
-			head, n->bias, (intptr_t)n->mutations, n->retro_weight, n->state_weight, n->state_forget, n->state_accum, n->state_init);
-	assert(r);
-	return r;
+/* The neuron format is compiled once, on first use, as brains are saved and
+ * loaded a neuron at a time; this is not thread safe. */
+static const format_t *neuron_format(void) {
+	static format_t *f = NULL;
+	if (!f)
+		f = format_compile("neuron (weights %v) (bias %f) (mutations %d) (retro %f) (state %f %f %f %f)");
+	return f;
 }
 
-static cell_t *layer_serialize(layer_t *layer) {
-	assert(layer);
-	cell_t *head = cons(mksym("layer"), nil());
-	cell_t *op   = head;
-	for (size_t i = 0; i < layer->length; op = cdr(op), i++)
-		setcdr(op, cons(neuron_serialize(layer->neurons[i]), nil()));
-	return head;
+static void neuron_serialize(const brain_t *b, size_t layer, size_t i, emitter_t *e) {
+	const double *n = neuron(b, layer, i);
+	format_emit(e, neuron_format(),
+		n + NEURON_WEIGHTS, b->length,
+		n[NEURON_BIAS],
+		(intptr_t)b->genes->mutations[(layer * b->length) + i],
+		n[NEURON_RETRO],
+		n[NEURON_STATE_WEIGHT], n[NEURON_STATE_FORGET], n[NEURON_STATE_ACCUM], n[NEURON_STATE_INIT]);
 }
 
-cell_t *brain_serialize(brain_t *b) {
+static void layer_serialize(const brain_t *b, size_t layer, emitter_t *e) {
 	assert(b);
-	cell_t *head = cons(mksym("layers"), nil());
-	cell_t *op = head;
-	for (size_t i = 0; i < b->depth; op = cdr(op), i++)
-		setcdr(op, cons(layer_serialize(b->layers[i]), nil()));
-	cell_t *r = printer("brain %x (depth %d) (length %d) ", head, (intptr_t)(b->depth), (intptr_t)(b->length));
-	assert(r);
-	return r;
+	emit_begin(e);
+	emit_symbol(e, "layer");
+	for (size_t i = 0; i < b->length; i++)
+		neuron_serialize(b, layer, i, e);
+	emit_end(e);
 }
 
-static void brain_apply_retro(brain_t *b, unsigned from, unsigned to) {
-	assert(b);
-	assert(from < b->depth);
-	assert(to < b->depth);
-	layer_t *f = b->layers[from];
-	layer_t *t = b->layers[to];
-	assert(t->length == f->length);
-	for (size_t i = 0; i < t->length; i++) {
-		neuron_t *n = t->neurons[i];
-		n->retro = &f->outputs[i];
-	}
+void brain_serialize(const brain_t *b, emitter_t *e) {
+	assert(b && e);
+	emit_begin(e);
+	emit_symbol(e, "brain");
+	emit_begin(e);
+	emit_symbol(e, "layers");
+	for (size_t i = 0; i < b->depth; i++)
+		layer_serialize(b, i, e);
+	emit_end(e);
+	emit_item_integer(e, "depth", b->depth);
+	emit_item_integer(e, "length", b->length);
+	emit_end(e);
 }
 
 static void brain_wire_up(brain_t *b) {
 	assert(b);
+	for (size_t i = 0; i < b->depth; i++)
+		b->retro[i] = NULL;
+	double *last = &b->outputs[(b->depth - 1) * b->length];
 	if (brain_retro_is_on)
-		brain_apply_retro(b, b->depth - 1, b->depth - 1);
+		b->retro[b->depth - 1] = last;
 	if (brain_mix_in_feedback)
-		brain_apply_retro(b, b->depth - 1, 0);
+		b->retro[0] = last;
 }
 
-brain_t *brain_new(bool alloc_layers, bool rand, size_t length, size_t depth) {
+/* Creates a brain with its own run time state around a set of parameters,
+ * the brain takes over the callers reference to them */
+static brain_t *brain_wrap(genes_t *genes, size_t length, size_t depth) {
+	assert(genes);
 	brain_t *b   = allocate(sizeof(*b));
-	b->length    = length < 1 ? 1 : length;
-	b->depth     = depth  < 2 ? 2 : depth;
+	b->length    = length;
+	b->depth     = depth;
+	b->genes     = genes;
 	b->inputs    = allocate(sizeof(b->inputs[0]) * length);
-	b->layers    = allocate(sizeof(b->layers[0]) * depth);
-	for (size_t i = 0; alloc_layers && i < b->depth; i++)
-		b->layers[i] = layer_new(true, rand, length);
-	if (alloc_layers)
-		brain_wire_up(b);
+	b->outputs   = allocate(sizeof(b->outputs[0]) * length * depth);
+	b->state     = allocate(sizeof(b->state[0]) * length * depth);
+	b->retro     = allocate(sizeof(b->retro[0]) * depth);
+	brain_wire_up(b);
+	brain_reset(b);
 	return b;
 }
 
+brain_t *brain_new(bool alloc_layers, bool rand, size_t length, size_t depth) {
+	length = length < 1 ? 1 : length;
+	depth  = depth  < 2 ? 2 : depth;
+	genes_t *g = genes_new(length, depth);
+	for (size_t i = 0; alloc_layers && i < depth * length; i++)
+		neuron_randomize(&g->parameters[i * row_length(length)], rand, length);
+	return brain_wrap(g, length, depth);
+}
+
+/* A copy shares the parameters of the original, it costs no more than the
+ * run time state until either brain is mutated */
 brain_t *brain_copy(const brain_t *b) {
 	assert(b);
-	brain_t *n = brain_new(false, false, b->length, b->depth);
-	for (size_t i = 0; i < b->depth; i++)
-		n->layers[i] = layer_copy(b->layers[i]);
-	brain_wire_up(n);
-	return n;
+	__atomic_add_fetch(&b->genes->references, 1, __ATOMIC_RELAXED);
+	return brain_wrap(b->genes, b->length, b->depth);
 }
 
 void brain_delete(brain_t *b) {
 	if (!b)
 		return;
+	genes_release(b->genes);
 	free(b->inputs);
-	if (b->layers)
-		for (size_t i = 0; i < b->depth; i++)
-			layer_delete(b->layers[i]);
+	free(b->outputs);
+	free(b->state);
+	free(b->retro);
 	free(b);
 }
 
@@ -254,138 +291,129 @@ static double activate(unsigned method, double value) {
 }
 
 /* see http://www.cs.bham.ac.uk/~jxb/NN/nn.html*/
-static double calculate_response(neuron_t *n, const double in[], size_t length) {
-	assert(n && in && length);
-	double total = n->bias;
+static double calculate_response(const double *n, double *state, const double *retro, const double in[], size_t length) {
+	assert(n && state && in && length);
+	double total = n[NEURON_BIAS];
+	const double *weights = &n[NEURON_WEIGHTS];
 	for (size_t i = 0; i < length; i++)
-		total += in[i] * n->weights[i];
+		total += in[i] * weights[i];
 	if (brain_internal_state_is_on)
-		total += n->state * n->state_weight;
-	if (n->retro)
-		total += *n->retro * n->retro_weight;
+		total += *state * n[NEURON_STATE_WEIGHT];
+	if (retro)
+		total += *retro * n[NEURON_RETRO];
 	const double a = activate(brain_activation_function, total);
 	if (brain_internal_state_is_on) {
-		n->state += a * n->state_accum;
-		n->state *= n->state_forget;
+		*state += a * n[NEURON_STATE_ACCUM];
+		*state *= n[NEURON_STATE_FORGET];
 	}
 	return a;
 }
 
-static inline void update_layer(layer_t *l, const double inputs[], const size_t in_length, const size_t start) {
-	assert(l);
+static inline void update_layer(brain_t *b, size_t layer, const double inputs[], const size_t in_length) {
+	assert(b);
 	assert(inputs);
 	assert(in_length);
-	size_t length = MIN(l->length, in_length);
-	for (size_t i = start; i < length; i++)
-		l->outputs[i] = calculate_response(l->neurons[i], inputs, length);
+	const size_t length = MIN(b->length, in_length);
+	double *outputs = &b->outputs[layer * b->length], *state = &b->state[layer * b->length];
+	const double *retro = b->retro[layer];
+	for (size_t i = 0; i < length; i++)
+		outputs[i] = calculate_response(neuron(b, layer, i), &state[i], retro ? &retro[i] : NULL, inputs, length);
 }
 
 void brain_update(brain_t *restrict b, const double *restrict inputs, const size_t in_length, double *restrict outputs, const size_t out_length) {
 	for (size_t i = 0; i < in_length; i++)
 		b->inputs[i] = inputs[i];
-	update_layer(b->layers[0], b->inputs, in_length, 0);
+	update_layer(b, 0, b->inputs, in_length);
 	for (size_t i = 1; i < b->depth; i++)
-		update_layer(b->layers[i], b->layers[i-1]->outputs, b->layers[i-1]->length, 0);
+		update_layer(b, i, &b->outputs[(i - 1) * b->length], b->length);
 	for (size_t i = 0; i < out_length; i++)
-		outputs[i] = b->layers[b->depth - 1]->outputs[i];
-}
-
-static void layer_mutate(layer_t *l, size_t depth, unsigned *count) {
-	assert(l && count);
-	unsigned muts = 0, total = 0;
-	for (size_t i = 0; i < l->length; i++) {
-		neuron_mutate(l->neurons[i], depth, &muts);
-		total += muts;
-	}
-	*count = total;
+		outputs[i] = b->outputs[((b->depth - 1) * b->length) + i];
 }
 
 unsigned brain_mutate(brain_t *b) {
 	assert(b);
-	unsigned muts = 0, total = 0;
-	for (size_t i = 0; i < b->depth; i++) {
-		layer_mutate(b->layers[i], b->depth, &muts);
-		total += muts;
-	}
+	unsigned total = 0;
+	for (size_t i = 0; i < b->depth; i++)
+		for (size_t j = 0; j < b->length; j++)
+			total += neuron_mutate(b, i, j);
 	return total;
 }
 
-neuron_t *neuron_deserialize(cell_t *c, size_t length) {
+static int neuron_deserialize(brain_t *b, size_t layer, size_t i, cell_t *c) {
 	double bias = 0, retro_weight = 0, state_weight = 0, state_forget = 0, state_accum = 0, state_init = 0;
 	intptr_t muts = 0;
-	cell_t *weights = NULL;
-	int r = scanner(c, "neuron (weights %l) (bias %f) (mutations %d) (retro %f) (state %f %f %f %f) ", weights, &bias, &muts, &retro_weight, &state_weight, &state_forget, &state_accum, &state_init);
-	if (r < 0 || !weights) {
+	size_t weights = 0;
+	double *n = neuron(b, layer, i);
+	int r = format_scan(neuron_format(), c, n + NEURON_WEIGHTS, b->length, &weights, &bias, &muts, &retro_weight, &state_weight, &state_forget, &state_accum, &state_init);
+	if (r < 0) {
 		warning("neuron deserialization failed: %d", r);
-		return NULL;
-	}
-	neuron_t *n = neuron_new(false, length);
-	for (size_t i = 0 ; type(weights) != NIL && i < length; i++, weights = cdr(weights)) {
-		cell_type_e wt = type(car(weights));
-		if (wt != FLOATING) {
-			warning("incorrect weight type %u", wt);
-			goto fail;
-		}
-		n->weights[i] = FLT(car(weights));
+		return -1;
 	}
-	n->mutations    = muts;
-	n->bias         = bias;
-	n->retro_weight = retro_weight;
-	n->state_weight = state_weight;
-	n->state_forget = state_forget;
-	n->state_accum  = state_accum;
-	n->state_init   = state_init;
-	return n;
-fail:
-	neuron_delete(n);
-	return NULL;
+	b->genes->mutations[(layer * b->length) + i] = muts;
+	n[NEURON_BIAS]         = bias;
+	n[NEURON_RETRO]        = retro_weight;
+	n[NEURON_STATE_WEIGHT] = state_weight;
+	n[NEURON_STATE_FORGET] = state_forget;
+	n[NEURON_STATE_ACCUM]  = state_accum;
+	n[NEURON_STATE_INIT]   = state_init;
+	return 0;
 }
 
-layer_t *layer_deserialize(cell_t *c, size_t length) {
-	layer_t *l = layer_new(false, false, length);
+static int layer_deserialize(brain_t *b, size_t layer, cell_t *c) {
 	c = cdr(c);
-	for (size_t i = 0; type(c) != NIL && i < length; i++, c = cdr(c)) {
-		l->neurons[i] = neuron_deserialize(car(c), length);
-		if (!(l->neurons[i])) {
+	size_t i = 0;
+	for (i = 0; type(c) != NIL && i < b->length; i++, c = cdr(c)) {
+		if (neuron_deserialize(b, layer, i, car(c)) < 0) {
 			warning("layer deserialization failed");
-			goto fail;
+			return -1;
 		}
 	}
-	return l;
-fail:
-	layer_delete(l);
-	return NULL;
+	if (i != b->length) {
+		warning("layer deserialization failed: expected %zu neurons, got %zu", b->length, i);
+		return -1;
+	}
+	return 0;
 }
 
 brain_t *brain_deserialize(cell_t *c) {
-	unsigned depth = 0, length = 0;
+	intptr_t depth = 0, length = 0;
 	cell_t *layers = NULL;
-	int r = scanner(c, "brain (layers %l) (depth %u) (length %u) ", &layers, &depth, &length);
+	static format_t *f = NULL;
+	if (!f)
+		f = format_compile("brain (layers %l) (depth %u) (length %u)");
+	int r = format_scan(f, c, &layers, &depth, &length);
 	if (r < 0 || layers == NULL)
 		return NULL;
+	if (depth < 2 || length < 1 || cell_length(layers) != (size_t)depth) {
+		warning("invalid configuration: expected %u layers", (unsigned)depth);
+		return NULL;
+	}
 	brain_t *b = brain_new(false, false, length, depth);
 	unsigned i;
 	for (i = 0; type(layers) != NIL; i++, layers = cdr(layers)) {
 		if (type(car(layers)) != CONS) {
 			warning("invalid configuration: layer is not list");
-			return NULL;
+			goto fail;
 		}
-		b->layers[i] = layer_deserialize(car(layers), length);
-		if (!b->layers[i]) {
+		if (layer_deserialize(b, i, car(layers)) < 0) {
 			warning("layers deserialization failed");
 			goto fail;
 		}
 	}
+	brain_reset(b);
 	return b;
 fail:
 	brain_delete(b);
 	return NULL;
 }
 
-static layer_t *layer_crossover(layer_t *a, layer_t *b, bool random) {
-	assert(a && b);
-	assert(a->length == b->length);
-	layer_t *l = layer_new(true, false, a->length);
+static void neuron_copy_over(brain_t *dst, const brain_t *src, size_t layer, size_t i) {
+	memcpy(neuron(dst, layer, i), neuron(src, layer, i), sizeof(double) * row_length(src->length));
+	dst->genes->mutations[(layer * dst->length) + i] = src->genes->mutations[(layer * src->length) + i];
+}
+
+static void layer_crossover(brain_t *c, const brain_t *a, const brain_t *b, size_t layer, bool random) {
+	assert(c && a && b);
 	bool swap = false;
 	for (size_t i = 0; i < a->length; i++) {
 		if (random) {
@@ -394,39 +422,98 @@ static layer_t *layer_crossover(layer_t *a, layer_t *b, bool random) {
 		} else {
 			swap = i >= (a->length * breeding_crossover_rate);
 		}
-		neuron_copy_over(l->neurons[i], swap ? a->neurons[i] : b->neurons[i]);
+		neuron_copy_over(c, swap ? a : b, layer, i);
 	}
-	return l;
 }
 
 brain_t *brain_crossover(brain_t *a, brain_t *b) {
 	assert(a && b);
 	assert(a->depth == b->depth && a->length == b->length);
-	brain_t *c = allocate(sizeof(*c));
-	c->depth = a->depth;
-	c->length = a->length;
-	c->inputs = allocate(sizeof(c->inputs[0]) * c->length);
-	c->layers = allocate(sizeof(c->layers[0]) * c->depth);
+	if (breeding_crossover_method == CROSSOVER_OFF)
+		return brain_copy(a);
+	brain_t *c = brain_new(false, false, a->length, a->depth);
 	for (size_t i = 0; i < c->depth; i++) {
 		switch (breeding_crossover_method) {
-		case CROSSOVER_OFF:
-			break;
 		case CROSSOVER_LAYER_SWAP:
-			if (i & 1)
-				c->layers[i] = layer_copy(a->layers[i]);
-			else
-				c->layers[i] = layer_copy(b->layers[i]);
+			for (size_t j = 0; j < c->length; j++)
+				neuron_copy_over(c, (i & 1) ? a : b, i, j);
 			break;
 		case CROSSOVER_NEURON_SWAP_FIXED:
-			c->layers[i] = layer_crossover(a->layers[i], b->layers[i], false);
+			layer_crossover(c, a, b, i, false);
 			break;
 		case CROSSOVER_NEURON_SWAP_RANDOM:
-			c->layers[i] = layer_crossover(a->layers[i], b->layers[i], true);
+			layer_crossover(c, a, b, i, true);
 			break;
 		default:
 			fatal("invalid crossover method: %u", breeding_crossover_method);
 		}
 	}
+	brain_reset(c);
 	return c;
 }
 
+/* The genome is a flat array containing all of the parameters of a brain,
+ * neuron by neuron and layer by layer, and can be used to move a brain
+ * between processes without going through the serialization code. */
+size_t brain_genome_length(const brain_t *b) {
+	assert(b);
+	return b->genes->count;
+}
+
+void brain_genome_export(const brain_t *b, double *genome) {
+	assert(b && genome);
+	memcpy(genome, b->genes->parameters, sizeof(genome[0]) * b->genes->count);
+}
+
+size_t brain_state_length(const brain_t *b) {
+	assert(b);
+	return 2 * b->depth * b->length;
+}
+
+void brain_state_export(const brain_t *b, double *state) {
+	assert(b && state);
+	const size_t n = b->depth * b->length;
+	memcpy(state,     b->outputs, sizeof(state[0]) * n);
+	memcpy(state + n, b->state,   sizeof(state[0]) * n);
+}
+
+void brain_state_import(brain_t *b, const double *state) {
+	assert(b && state);
+	const size_t n = b->depth * b->length;
+	memcpy(b->outputs, state,     sizeof(state[0]) * n);
+	memcpy(b->state,   state + n, sizeof(state[0]) * n);
+}
+
+size_t brain_neurons(const brain_t *b) {
+	assert(b);
+	return b->depth * b->length;
+}
+
+void brain_mutations_export(const brain_t *b, uint64_t *mutations) {
+	assert(b && mutations);
+	for (size_t i = 0; i < b->depth * b->length; i++)
+		mutations[i] = b->genes->mutations[i];
+}
+
+void brain_mutations_import(brain_t *b, const uint64_t *mutations) {
+	assert(b && mutations);
+	genes_unshare(b);
+	for (size_t i = 0; i < b->depth * b->length; i++)
+		b->genes->mutations[i] = mutations[i];
+}
+
+/* Brains with the same shape and parameters have the same hash, run time
+ * state does not contribute to it */
+uint64_t brain_hash(const brain_t *b) {
+	assert(b);
+	return hash64(b->genes->parameters, sizeof(b->genes->parameters[0]) * b->genes->count, (b->length << 32) ^ b->depth);
+}
+
+/* Importing a genome also resets the run time state of the brain, so a brain
+ * behaves the same regardless of what it was doing before the import. */
+void brain_genome_import(brain_t *b, const double *genome) {
+	assert(b && genome);
+	genes_unshare(b);
+	memcpy(b->genes->parameters, genome, sizeof(genome[0]) * b->genes->count);
+	brain_reset(b);
+}
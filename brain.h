@@ -32,8 +32,26 @@ void brain_delete(brain_t *b);
 void brain_update(brain_t *restrict b, const double *restrict inputs, const size_t in_length, double *restrict outputs, const size_t out_length);
 
 unsigned brain_mutate(brain_t *b);
-cell_t *brain_serialize(brain_t *b);
+void brain_serialize(const brain_t *b, emitter_t *e);
 brain_t *brain_deserialize(cell_t *c);
 brain_t *brain_crossover(brain_t *a, brain_t *b);
 
+size_t brain_genome_length(const brain_t *b);
+void brain_genome_export(const brain_t *b, double *genome);
+void brain_genome_import(brain_t *b, const double *genome);
+uint64_t brain_hash(const brain_t *b);
+
+/** The run time state of a brain, the outputs of every neuron and their
+ * internal state, carries over from one match to the next; it is not part
+ * of the genome but is needed to carry on a run exactly. */
+size_t brain_state_length(const brain_t *b);
+void brain_state_export(const brain_t *b, double *state);
+void brain_state_import(brain_t *b, const double *state);
+
+/** The number of times each neuron has been mutated, one count per neuron,
+ * is also kept apart from the genome. */
+size_t brain_neurons(const brain_t *b);
+void brain_mutations_export(const brain_t *b, uint64_t *mutations);
+void brain_mutations_import(brain_t *b, const uint64_t *mutations);
+
 #endif
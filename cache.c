@@ -0,0 +1,74 @@
+/** @file       cache.c
+ *  @brief      A fixed size cache of match results
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com
+ *
+ * The cache is direct mapped; a key can only live in one entry and a new
+ * key replaces whatever was there before. Recent results are the most
+ * likely to be asked for again, as duplicates of a genome appear together
+ * in a generation, so nothing smarter is needed. */
+#include "cache.h"
+#include "util.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct cache_t {
+	size_t entries, length;
+	size_t lookups, hits;
+	uint64_t *keys;
+	bool *valid;
+	double *values;
+};
+
+cache_t *cache_new(size_t entries, size_t length) {
+	assert(entries && length);
+	cache_t *c = allocate(sizeof(*c));
+	c->entries = entries;
+	c->length  = length;
+	c->keys    = allocate(sizeof(c->keys[0]) * entries);
+	c->valid   = allocate(sizeof(c->valid[0]) * entries);
+	c->values  = allocate(sizeof(c->values[0]) * entries * length);
+	return c;
+}
+
+void cache_delete(cache_t *c) {
+	if (!c)
+		return;
+	free(c->keys);
+	free(c->valid);
+	free(c->values);
+	free(c);
+}
+
+const double *cache_lookup(cache_t *c, uint64_t key) {
+	assert(c);
+	const size_t i = key % c->entries;
+	c->lookups++;
+	if (!c->valid[i] || c->keys[i] != key)
+		return NULL;
+	c->hits++;
+	return &c->values[i * c->length];
+}
+
+void cache_insert(cache_t *c, uint64_t key, const double *value) {
+	assert(c && value);
+	const size_t i = key % c->entries;
+	c->valid[i] = true;
+	c->keys[i]  = key;
+	memcpy(&c->values[i * c->length], value, sizeof(value[0]) * c->length);
+}
+
+void cache_statistics(const cache_t *c, size_t *lookups, size_t *hits) {
+	assert(c && lookups && hits);
+	*lookups = c->lookups;
+	*hits    = c->hits;
+}
+
+void cache_statistics_reset(cache_t *c) {
+	assert(c);
+	c->lookups = 0;
+	c->hits    = 0;
+}
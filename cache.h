@@ -0,0 +1,29 @@
+/** @file       cache.h
+ *  @brief      A fixed size cache of match results
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com*/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct cache_t;
+typedef struct cache_t cache_t;
+
+/** Each of the 'entries' holds 'length' doubles, the key is assumed to be a
+ * good hash of everything that determines the value */
+cache_t *cache_new(size_t entries, size_t length);
+void cache_delete(cache_t *c);
+
+/** Returns NULL on a miss, the pointer is valid until the next insert */
+const double *cache_lookup(cache_t *c, uint64_t key);
+void cache_insert(cache_t *c, uint64_t key, const double *value);
+
+/** Lookups and hits since the statistics were last reset */
+void cache_statistics(const cache_t *c, size_t *lookups, size_t *hits);
+void cache_statistics_reset(cache_t *c);
+
+#endif
@@ -0,0 +1,123 @@
+/** @file       es.c
+ *  @brief      An evolution strategy optimizer over a flat genome
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com
+ *
+ * See "Evolution Strategies as a Scalable Alternative to Reinforcement
+ * Learning" (Salimans et al, 2017). A single center genome is perturbed
+ * with Gaussian noise, each perturbation is evaluated both added to and
+ * subtracted from the center (antithetic or mirrored sampling), and the
+ * center is moved along the noise weighted by how the two candidates of
+ * each pair fared. Fitness is replaced by its centered rank before use so
+ * the size and offset of the fitness values do not matter. */
+#include "es.h"
+#include "parallel.h"
+#include "rank.h"
+#include "util.h"
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct es_t {
+	size_t length, pairs;
+	double sigma, learning_rate;
+	uint64_t seed;
+	double *center;
+	double *noise; /* pairs * length */
+};
+
+es_t *es_new(const double *center, size_t length, size_t pairs, double sigma, double learning_rate) {
+	assert(center && length && pairs);
+	es_t *e = allocate(sizeof(*e));
+	e->length = length;
+	e->pairs  = pairs;
+	e->sigma  = sigma;
+	e->learning_rate = learning_rate;
+	e->center = allocate(sizeof(e->center[0]) * length);
+	e->noise  = allocate(sizeof(e->noise[0]) * length * pairs);
+	memcpy(e->center, center, sizeof(e->center[0]) * length);
+	return e;
+}
+
+void es_delete(es_t *e) {
+	if (!e)
+		return;
+	free(e->center);
+	free(e->noise);
+	free(e);
+}
+
+/* Box-Muller transform, both values are used */
+static void es_pair_sample(void *param, size_t pair) {
+	es_t *e = param;
+	assert(e && pair < e->pairs);
+	random_seed_u64(e->seed + pair);
+	double *n = &e->noise[pair * e->length];
+	for (size_t i = 0; i < e->length; i += 2) {
+		const double u = MAX(random_float(), DBL_MIN), v = random_float();
+		const double r = sqrt(-2.0 * log(u));
+		n[i] = r * cos(2.0 * PI * v);
+		if (i + 1 < e->length)
+			n[i + 1] = r * sin(2.0 * PI * v);
+	}
+}
+
+void es_sample(es_t *e, uint64_t seed, unsigned threads) {
+	assert(e);
+	e->seed = seed;
+	const prng_t saved = random_state();
+	parallel_for(threads, e->pairs, es_pair_sample, e);
+	random_state_set(&saved);
+}
+
+void es_candidate(const es_t *e, size_t candidate, double *genome) {
+	assert(e && genome);
+	const size_t pair = candidate / 2;
+	if (pair >= e->pairs) {
+		memcpy(genome, e->center, sizeof(genome[0]) * e->length);
+		return;
+	}
+	const double *n = &e->noise[pair * e->length];
+	const double sigma = (candidate & 1) ? -e->sigma : e->sigma;
+	for (size_t i = 0; i < e->length; i++)
+		genome[i] = e->center[i] + (sigma * n[i]);
+}
+
+void es_update(es_t *e, const double *fitness) {
+	assert(e && fitness);
+	const size_t count = e->pairs * 2;
+	rank_t *order = allocate(sizeof(order[0]) * count);
+	double *rank = allocate(sizeof(rank[0]) * count);
+	rank_fill(order, fitness, count);
+	rank_top(order, count, count);
+	for (size_t i = 0; i < count; i++) /* centered ranks in [-0.5, 0.5] */
+		rank[order[i].index] = 0.5 - ((double)i / (count - 1));
+	const double step = e->learning_rate / (e->pairs * e->sigma);
+	for (size_t p = 0; p < e->pairs; p++) {
+		const double weight = step * (rank[2 * p] - rank[(2 * p) + 1]);
+		const double *restrict n = &e->noise[p * e->length];
+		double *restrict c = e->center;
+		for (size_t i = 0; i < e->length; i++)
+			c[i] += weight * n[i];
+	}
+	free(rank);
+	free(order);
+}
+
+const double *es_center(const es_t *e) {
+	assert(e);
+	return e->center;
+}
+
+size_t es_pairs(const es_t *e) {
+	assert(e);
+	return e->pairs;
+}
+
+uint64_t es_seed(const es_t *e) {
+	assert(e);
+	return e->seed;
+}
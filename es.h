@@ -0,0 +1,36 @@
+/** @file       es.h
+ *  @brief      An evolution strategy optimizer over a flat genome
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com*/
+
+#ifndef ES_H
+#define ES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct es_t;
+typedef struct es_t es_t;
+
+es_t *es_new(const double *center, size_t length, size_t pairs, double sigma, double learning_rate);
+void es_delete(es_t *e);
+
+/** Draw new noise for each pair of candidates, with 'threads' threads; the
+ * noise only depends on the seed */
+void es_sample(es_t *e, uint64_t seed, unsigned threads);
+
+/** Candidates 2i and 2i+1 are the center plus and minus the noise of pair
+ * i, any other candidate is the center itself */
+void es_candidate(const es_t *e, size_t candidate, double *genome);
+
+/** Move the center using the fitness of the 2 * pairs candidates */
+void es_update(es_t *e, const double *fitness);
+
+const double *es_center(const es_t *e);
+size_t es_pairs(const es_t *e);
+
+/** The seed of the last sample, sampling again with it restores the noise */
+uint64_t es_seed(const es_t *e);
+
+#endif
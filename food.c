@@ -77,12 +77,15 @@ void food_deactive(food_t *f) {
 	f->eaten = true;
 }
 
-cell_t *food_serialize(food_t *f) {
-	assert(f);
-	cell_t *n = printer("food (x %f) (y %f) (orientation %f) (eaten %d)",
-			f->x, f->y, f->orientation, (intptr_t)(f->eaten));
-	assert(n);
-	return n;
+void food_serialize(food_t *f, emitter_t *e) {
+	assert(f && e);
+	emit_begin(e);
+	emit_symbol(e, "food");
+	emit_item_float(e,   "x",           f->x);
+	emit_item_float(e,   "y",           f->y);
+	emit_item_float(e,   "orientation", f->orientation);
+	emit_item_integer(e, "eaten",       f->eaten);
+	emit_end(e);
 }
 
 food_t *food_deserialize(cell_t *c) {
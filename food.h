@@ -29,7 +29,7 @@ void food_update(food_t *f);
 bool food_is_active(food_t *f);
 void food_reactivate(food_t *f, double x, double y, double orientation);
 void food_deactive(food_t *f);
-cell_t *food_serialize(food_t *f);
+void food_serialize(food_t *f, emitter_t *e);
 food_t *food_deserialize(cell_t *c);
 
 #endif
@@ -129,10 +129,33 @@ void gladiator_draw(gladiator_t *g) {
 		draw_text(WHITE, g->x, g->y - g->radius*2, "%g/%g/%u/%g", g->health, g->energy, g->team, g->fitness);
 }
 
-gladiator_t *gladiator_new(unsigned team, double x, double y, double orientation) {
+/* The brain must be able to accommodate all of the inputs and outputs */
+static size_t gladiator_brain_neurons(void) {
+	size_t length = MAX(gladiator_brain_length, GLADIATOR_IN_LAST_INPUT);
+	return MAX(length, GLADIATOR_OUT_LAST_OUTPUT);
+}
+
+size_t gladiator_genome_length(void) {
+	brain_t *b = brain_new(false, false, gladiator_brain_neurons(), gladiator_brain_depth);
+	const size_t length = brain_genome_length(b);
+	brain_delete(b);
+	return length;
+}
+
+static color_t random_color(void) {
+	color_t c = { .a = 1.0 };
+	c.r = random_float()*0.8;
+	c.g = random_float()*0.8;
+	c.b = random_float()*0.8;
+	return c;
+}
+
+/* Takes ownership of the brain */
+static gladiator_t *gladiator_make(unsigned team, double x, double y, double orientation, brain_t *brain, color_t color) {
 	/*assert(team < arena_gladiator_count);*/
 	assert(x >= Xmin && x <= Xmax);
 	assert(y >= Ymin && y <= Ymax);
+	assert(brain);
 	gladiator_t *g = allocate(sizeof(*g));
 	g->team = team;
 	g->x = wrap_or_limit_x(x);
@@ -141,16 +164,29 @@ gladiator_t *gladiator_new(unsigned team, double x, double y, double orientation
 	g->field_of_view = PI / 3.0;
 	g->health = gladiator_health;
 	g->radius = gladiator_size;
-	g->color.a = 1.0;
-	g->color.r = random_float()*0.8;
-	g->color.g = random_float()*0.8;
-	g->color.b = random_float()*0.8;
-	size_t length = MAX(gladiator_brain_length, GLADIATOR_IN_LAST_INPUT);
-	length = MAX(length, GLADIATOR_OUT_LAST_OUTPUT);
-	g->brain = brain_new(true, true, length, gladiator_brain_depth);
+	g->color = color;
+	g->brain = brain;
+	g->hash = brain_hash(brain);
 	return g;
 }
 
+gladiator_t *gladiator_new(unsigned team, double x, double y, double orientation) {
+	const color_t color = random_color();
+	return gladiator_make(team, x, y, orientation, brain_new(true, true, gladiator_brain_neurons(), gladiator_brain_depth), color);
+}
+
+gladiator_t *gladiator_new_with_brain(unsigned team, double x, double y, double orientation, brain_t *brain) {
+	return gladiator_make(team, x, y, orientation, brain, random_color());
+}
+
+/* The genome must be 'gladiator_genome_length' parameters long */
+gladiator_t *gladiator_new_with_genome(unsigned team, double x, double y, double orientation, const double *genome) {
+	assert(genome);
+	brain_t *b = brain_new(false, false, gladiator_brain_neurons(), gladiator_brain_depth);
+	brain_genome_import(b, genome);
+	return gladiator_new_with_brain(team, x, y, orientation, b);
+}
+
 void gladiator_delete(gladiator_t *g) {
 	assert(g);
 	if (g->brain)
@@ -160,15 +196,16 @@ void gladiator_delete(gladiator_t *g) {
 
 unsigned gladiator_mutate(gladiator_t *g) {
 	assert(g);
-	return brain_mutate(g->brain);
+	const unsigned mutations = brain_mutate(g->brain);
+	if (mutations)
+		g->hash = brain_hash(g->brain);
+	return mutations;
 }
 
 gladiator_t *gladiator_copy(gladiator_t *g) {
 	assert(g);
-	gladiator_t *n = gladiator_new(g->team, g->x, g->y, g->orientation);
-	brain_delete(n->brain);
+	gladiator_t *n = gladiator_make(g->team, g->x, g->y, g->orientation, brain_copy(g->brain), g->color);
 	n->fitness = g->fitness;
-	n->brain = brain_copy(g->brain);
 	return n;
 }
 
@@ -184,51 +221,46 @@ double gladiator_fitness(gladiator_t *g) {
 	fitness += g->time_alive * fitness_weight_time_alive;
 	fitness += g->fired      * fitness_weight_fired;
 	fitness += timer_result(&g->wall_contact_timer) * fitness_weight_wall_time;
+	fitness += g->stalemate  * fitness_weight_stalemate;
+	fitness += g->benchmark  * fitness_weight_hall_of_fame;
 	return fitness;
 }
 
 gladiator_t *gladiator_breed(gladiator_t *a, gladiator_t *b) {
-	gladiator_t *child = gladiator_new(a->team, 0, 0, 0);
-	brain_delete(child->brain);
+	color_t color = { .a = 1.0 };
+	color.r = (a->color.r + b->color.r) / 2.0;
+	color.g = (a->color.g + b->color.g) / 2.0;
+	color.b = (a->color.b + b->color.b) / 2.0;
+	gladiator_t *child = gladiator_make(a->team, 0, 0, 0, brain_crossover(a->brain, b->brain), color);
 	child->mutations = MAX(a->mutations, b->mutations); /* This should be done on a per neuron basis */
 	child->fitness   = (a->fitness + b->fitness) / 2.0;
-	child->brain     = brain_crossover(a->brain, b->brain);
 	return child;
 }
 
-cell_t *gladiator_serialize(gladiator_t *g) {
-	assert(g);
+void gladiator_serialize(gladiator_t *g, emitter_t *e) {
+	assert(g && e);
 	assert(g->brain);
-
-	cell_t *b = brain_serialize(g->brain);
-	assert(b);
-	cell_t *c = printer(
-			"gladiator "
-			" %x "
-			"(x %f) (y %f) (orientation %f) "
-			"(field-of-view %f) "
-			"(health %f) "
-			"(team %d) (hits %d) (foods %d) (fired %d) "
-			"(energy %f) "
-			"(mutations %d) "
-			"(fitness %f) ",
-			b,
-			g->x, g->y, g->orientation,
-			g->field_of_view,
-			g->health,
-			(intptr_t)(g->team), (intptr_t)(g->hits), (intptr_t)(g->foods), (intptr_t)(g->fired),
-			g->energy,
-			(intptr_t)g->mutations, 
-			g->fitness);
-	assert(c);
-	return c;
+	emit_begin(e);
+	emit_symbol(e, "gladiator");
+	brain_serialize(g->brain, e);
+	emit_item_float(e,   "x",             g->x);
+	emit_item_float(e,   "y",             g->y);
+	emit_item_float(e,   "orientation",   g->orientation);
+	emit_item_float(e,   "field-of-view", g->field_of_view);
+	emit_item_float(e,   "health",        g->health);
+	emit_item_integer(e, "team",          g->team);
+	emit_item_integer(e, "hits",          g->hits);
+	emit_item_integer(e, "foods",         g->foods);
+	emit_item_integer(e, "fired",         g->fired);
+	emit_item_float(e,   "energy",        g->energy);
+	emit_item_integer(e, "mutations",     g->mutations);
+	emit_item_float(e,   "fitness",       g->fitness);
+	emit_end(e);
 }
 
 gladiator_t *gladiator_deserialize(cell_t *c) {
 	assert(c);
-	gladiator_t *g = gladiator_new(0, 0, 0, 0);
-	brain_delete(g->brain);
-	g->brain = NULL;
+	gladiator_t t = { .brain = NULL };
 	intptr_t team = 0, hits = 0, foods = 0, mutations = 0, fired = 0;
 	cell_t *cb = NULL;
 
@@ -243,24 +275,29 @@ gladiator_t *gladiator_deserialize(cell_t *c) {
 			"(mutations %d) "
 			"(fitness %f) ",
 			&cb,
-			&g->x, &g->y, &g->orientation,
-			&g->field_of_view,
-			&g->health,
+			&t.x, &t.y, &t.orientation,
+			&t.field_of_view,
+			&t.health,
 			&team, &hits, &foods, &fired,
-			&g->energy,
+			&t.energy,
 			&mutations, 
-			&g->fitness);
+			&t.fitness);
 	if (r < 0) {
 		warning("gladiator deserialization failed");
 		return NULL;
 	}
-	brain_t *b = brain_deserialize(cb);
-	if (!b) {
-		gladiator_delete(g);
+	if (t.x < Xmin || t.x > Xmax || t.y < Ymin || t.y > Ymax) {
+		warning("gladiator deserialization failed: out of bounds");
 		return NULL;
 	}
-	g->brain = b;
-	g->team = team;
+	brain_t *b = brain_deserialize(cb);
+	if (!b)
+		return NULL;
+	gladiator_t *g = gladiator_new_with_brain(team, t.x, t.y, t.orientation, b);
+	g->field_of_view = t.field_of_view;
+	g->health = t.health;
+	g->energy = t.energy;
+	g->fitness = t.fitness;
 	g->hits = hits;
 	g->foods = foods;
 	g->mutations = mutations;
@@ -268,3 +305,37 @@ gladiator_t *gladiator_deserialize(cell_t *c) {
 	return g;
 }
 
+
+void gladiator_state_export(const gladiator_t *g, double state[GLADIATOR_STATE_LAST]) {
+	assert(g && state);
+	state[GLADIATOR_STATE_X]              = g->x;
+	state[GLADIATOR_STATE_Y]              = g->y;
+	state[GLADIATOR_STATE_ORIENTATION]    = g->orientation;
+	state[GLADIATOR_STATE_FIELD_OF_VIEW]  = g->field_of_view;
+	state[GLADIATOR_STATE_HEALTH]         = g->health;
+	state[GLADIATOR_STATE_ENERGY]         = g->energy;
+	state[GLADIATOR_STATE_HITS]           = g->hits;
+	state[GLADIATOR_STATE_FOODS]          = g->foods;
+	state[GLADIATOR_STATE_FIRED]          = g->fired;
+	state[GLADIATOR_STATE_TIME_ALIVE]     = g->time_alive;
+	state[GLADIATOR_STATE_REFIRE_TIMEOUT] = g->refire_timeout;
+	state[GLADIATOR_STATE_WALL_CONTACT]   = g->wall_contact_timer.i;
+	state[GLADIATOR_STATE_STALEMATE]      = g->stalemate;
+}
+
+void gladiator_state_import(gladiator_t *g, const double state[GLADIATOR_STATE_LAST]) {
+	assert(g && state);
+	g->x                    = state[GLADIATOR_STATE_X];
+	g->y                    = state[GLADIATOR_STATE_Y];
+	g->orientation          = state[GLADIATOR_STATE_ORIENTATION];
+	g->field_of_view        = state[GLADIATOR_STATE_FIELD_OF_VIEW];
+	g->health               = state[GLADIATOR_STATE_HEALTH];
+	g->energy               = state[GLADIATOR_STATE_ENERGY];
+	g->hits                 = state[GLADIATOR_STATE_HITS];
+	g->foods                = state[GLADIATOR_STATE_FOODS];
+	g->fired                = state[GLADIATOR_STATE_FIRED];
+	g->time_alive           = state[GLADIATOR_STATE_TIME_ALIVE];
+	g->refire_timeout       = state[GLADIATOR_STATE_REFIRE_TIMEOUT];
+	g->wall_contact_timer.i = state[GLADIATOR_STATE_WALL_CONTACT];
+	g->stalemate            = state[GLADIATOR_STATE_STALEMATE] != 0.0;
+}
@@ -31,8 +31,13 @@ typedef struct {
 	unsigned mutations; /**< mutations from previous round*/
 	unsigned refire_timeout; /**< time left until next fire allowed */
 	double fitness; /**< parents fitness level*/
+	double benchmark; /**< mean score against opponents from the hall of fame*/
 	brain_t *brain; /**< the gladiators brain*/
+	uint64_t hash; /**< hash of the brains genome, updated when it changes*/
+	uint64_t id; /**< id in the lineage archive, zero if not archived*/
 	timer_tick_t wall_contact_timer; /**< timer for the amount of gladiator has been in contact with the wall*/
+	cartesian_t anchor; /**< position at the start of the stalemate detection window*/
+	bool stalemate; /**< set if the last match ended in a stalemate*/
 	color_t color;
 } gladiator_t;
 
@@ -75,8 +80,35 @@ typedef enum {
 #undef X
 } gladiator_output_e;
 
+/* The part of a gladiators state that changes during a match, it can be
+ * exported to and imported from a flat array of doubles so matches can be
+ * run elsewhere, such as in another process. */
+#define X_MACRO_GLADIATOR_STATE\
+	X(GLADIATOR_STATE_X,              "x position")\
+	X(GLADIATOR_STATE_Y,              "y position")\
+	X(GLADIATOR_STATE_ORIENTATION,    "orientation")\
+	X(GLADIATOR_STATE_FIELD_OF_VIEW,  "field of view")\
+	X(GLADIATOR_STATE_HEALTH,         "health")\
+	X(GLADIATOR_STATE_ENERGY,         "energy")\
+	X(GLADIATOR_STATE_HITS,           "hits")\
+	X(GLADIATOR_STATE_FOODS,          "foods")\
+	X(GLADIATOR_STATE_FIRED,          "fired")\
+	X(GLADIATOR_STATE_TIME_ALIVE,     "time alive")\
+	X(GLADIATOR_STATE_REFIRE_TIMEOUT, "refire timeout")\
+	X(GLADIATOR_STATE_WALL_CONTACT,   "wall contact timer")\
+	X(GLADIATOR_STATE_STALEMATE,      "match ended in stalemate")\
+	X(GLADIATOR_STATE_LAST,           "INVALID STATE")
+
+typedef enum {
+#define X(ENUM, DESCRIPTION) ENUM,
+	X_MACRO_GLADIATOR_STATE
+#undef X
+} gladiator_state_e;
+
 void gladiator_draw(gladiator_t *g);
 gladiator_t *gladiator_new(unsigned team, double x, double y, double orientation);
+gladiator_t *gladiator_new_with_brain(unsigned team, double x, double y, double orientation, brain_t *brain);
+gladiator_t *gladiator_new_with_genome(unsigned team, double x, double y, double orientation, const double *genome);
 gladiator_t *gladiator_copy(gladiator_t *g);
 void gladiator_update(gladiator_t *g, const double inputs[], double outputs[]);
 void gladiator_delete(gladiator_t *g);
@@ -85,7 +117,10 @@ unsigned gladiator_mutate(gladiator_t *g);
 bool gladiator_is_dead(gladiator_t *g);
 const char *lookup_gladiator_io_name(bool lookup_input, unsigned port);
 gladiator_t *gladiator_breed(gladiator_t *a, gladiator_t *b);
-cell_t *gladiator_serialize(gladiator_t *p);
+void gladiator_serialize(gladiator_t *g, emitter_t *e);
 gladiator_t *gladiator_deserialize(cell_t *c);
+size_t gladiator_genome_length(void);
+void gladiator_state_export(const gladiator_t *g, double state[GLADIATOR_STATE_LAST]);
+void gladiator_state_import(gladiator_t *g, const double state[GLADIATOR_STATE_LAST]);
 
 #endif
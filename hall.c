@@ -0,0 +1,94 @@
+/** @file       hall.c
+ *  @brief      A hall of fame; an archive of past champions
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com
+ *
+ * Only the genomes of champions are kept, not whole gladiators, one after
+ * another in a single array. Archived genomes are never changed, they can
+ * be copied straight into a worker pool to be played against. */
+#include "hall.h"
+#include "util.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct hall_t {
+	size_t capacity, count, next;
+	size_t genome_length;
+	uint64_t *hashes;
+	double *genomes; /* capacity * genome_length */
+};
+
+hall_t *hall_new(size_t capacity, size_t genome_length) {
+	assert(capacity && genome_length);
+	hall_t *h = allocate(sizeof(*h));
+	h->capacity = capacity;
+	h->genome_length = genome_length;
+	h->hashes  = allocate(sizeof(h->hashes[0]) * capacity);
+	h->genomes = allocate(sizeof(h->genomes[0]) * capacity * genome_length);
+	return h;
+}
+
+void hall_delete(hall_t *h) {
+	if (!h)
+		return;
+	free(h->hashes);
+	free(h->genomes);
+	free(h);
+}
+
+bool hall_add(hall_t *h, uint64_t hash, const double *genome) {
+	assert(h && genome);
+	for (size_t i = 0; i < h->count; i++)
+		if (h->hashes[i] == hash)
+			return false;
+	const size_t i = h->next;
+	h->hashes[i] = hash;
+	memcpy(&h->genomes[i * h->genome_length], genome, sizeof(genome[0]) * h->genome_length);
+	h->next = (h->next + 1) % h->capacity;
+	h->count = MIN(h->count + 1, h->capacity);
+	return true;
+}
+
+size_t hall_count(const hall_t *h) {
+	assert(h);
+	return h->count;
+}
+
+const double *hall_genome(const hall_t *h, size_t entry) {
+	assert(h && entry < h->count);
+	return &h->genomes[entry * h->genome_length];
+}
+
+uint64_t hall_hash(const hall_t *h, size_t entry) {
+	assert(h && entry < h->count);
+	return h->hashes[entry];
+}
+
+size_t hall_next(const hall_t *h) {
+	assert(h);
+	return h->next;
+}
+
+void hall_set_next(hall_t *h, size_t next) {
+	assert(h && next < h->capacity);
+	h->next = next;
+}
+
+/* A partial Fisher-Yates shuffle over the entry indices */
+size_t hall_sample(const hall_t *h, size_t *entries, size_t k) {
+	assert(h && entries);
+	k = MIN(k, h->count);
+	size_t order[h->count ? h->count : 1];
+	for (size_t i = 0; i < h->count; i++)
+		order[i] = i;
+	for (size_t i = 0; i < k; i++) {
+		const size_t j = i + (random_u64() % (h->count - i));
+		const size_t t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+		entries[i] = order[i];
+	}
+	return k;
+}
@@ -0,0 +1,36 @@
+/** @file       hall.h
+ *  @brief      A hall of fame; an archive of past champions
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com*/
+
+#ifndef HALL_H
+#define HALL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct hall_t;
+typedef struct hall_t hall_t;
+
+hall_t *hall_new(size_t capacity, size_t genome_length);
+void hall_delete(hall_t *h);
+
+/** Add a champion, returns false if a genome with the same hash is already
+ * present. When the hall is full the oldest entry is replaced. */
+bool hall_add(hall_t *h, uint64_t hash, const double *genome);
+size_t hall_count(const hall_t *h);
+const double *hall_genome(const hall_t *h, size_t entry);
+uint64_t hall_hash(const hall_t *h, size_t entry);
+
+/** Draw up to 'k' distinct entries, returns the number drawn */
+size_t hall_sample(const hall_t *h, size_t *entries, size_t k);
+
+/** The entry the next champion goes into once the hall is full; adding the
+ * entries of a hall in order to a new one and then setting this restores
+ * it exactly. */
+size_t hall_next(const hall_t *h);
+void hall_set_next(hall_t *h, size_t next);
+
+#endif
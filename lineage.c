@@ -0,0 +1,250 @@
+/** @file       lineage.c
+ *  @brief      An append only archive of every genome and its parents
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com
+ *
+ * The archive is a header followed by one record per genome:
+ *
+ * 	id, parent a, parent b (uint64_t), generation, count (uint32_t)
+ * 	keyframe: 'count' parameters (double), where count is the genome length
+ * 	delta:    'count' indices (uint32_t) then 'count' parameters (double)
+ *
+ * A delta holds only the parameters that differ from parent 'a', a genome
+ * is stored as a keyframe if it has no parents, if its delta would be no
+ * smaller than a keyframe, or if rebuilding it would go through more than
+ * 'lineage_keyframe_interval' deltas. A copy that has not been mutated
+ * costs just a record header.
+ *
+ * The index is a header followed by a fixed size entry per genome, entry
+ * 'id - 1' holds the offset of the record, so any record can be found
+ * with a single seek. Both files use native byte order. */
+#include "lineage.h"
+#include "util.h"
+#include "vars.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINEAGE_VERSION (1u)
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint64_t genome_length;
+} lineage_header_t;
+
+typedef struct {
+	uint64_t id, a, b;
+	uint32_t generation, count;
+} record_t;
+
+typedef struct {
+	uint64_t offset;
+	uint32_t generation;
+	uint32_t depth; /* deltas to go through to rebuild, zero for a keyframe */
+} entry_t;
+
+struct lineage_t {
+	FILE *archive, *index;
+	bool write;
+	size_t genome_length;
+	entry_t *entries;
+	uint64_t count, max;
+	uint32_t *indices; /* scratch space for a delta */
+	double *values;
+};
+
+static const char archive_magic[4] = { 'G', 'L', 'I', 'N' }, index_magic[4] = { 'G', 'L', 'I', 'X' };
+
+static int header_write(FILE *f, const char magic[4], size_t genome_length) {
+	lineage_header_t h = { .version = LINEAGE_VERSION, .genome_length = genome_length };
+	memcpy(h.magic, magic, sizeof(h.magic));
+	return fwrite(&h, sizeof(h), 1, f) == 1 ? 0 : -1;
+}
+
+static int header_read(FILE *f, const char magic[4], size_t *genome_length) {
+	lineage_header_t h;
+	if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, magic, sizeof(h.magic)) || h.version != LINEAGE_VERSION)
+		return -1;
+	*genome_length = h.genome_length;
+	return 0;
+}
+
+static void entry_push(lineage_t *l, entry_t e) {
+	if (l->count == l->max) {
+		l->max = l->max ? l->max * 2 : 1024;
+		entry_t *n = realloc(l->entries, sizeof(l->entries[0]) * l->max);
+		if (!n)
+			fatal("allocation failed of size %zu\n", (size_t)(sizeof(l->entries[0]) * l->max));
+		l->entries = n;
+	}
+	l->entries[l->count++] = e;
+}
+
+static lineage_t *lineage_new(const char *archive, const char *index, size_t genome_length, bool write, bool append) {
+	assert(archive && index);
+	lineage_t *l = allocate(sizeof(*l));
+	l->write = write;
+	const char *mode = append ? "r+b" : write ? "w+b" : "rb";
+	l->archive = fopen(archive, mode);
+	l->index   = fopen(index, mode);
+	if (!l->archive || !l->index) {
+		warning("could not open lineage archive '%s' or index '%s'", archive, index);
+		goto fail;
+	}
+	if (write && !append) {
+		if (!genome_length || header_write(l->archive, archive_magic, genome_length) < 0 || header_write(l->index, index_magic, genome_length) < 0)
+			goto fail;
+	} else {
+		size_t archive_length = 0, index_length = 0;
+		if (header_read(l->archive, archive_magic, &archive_length) < 0 || header_read(l->index, index_magic, &index_length) < 0
+				|| index_length != archive_length || !archive_length || (append && archive_length != genome_length)) {
+			warning("invalid lineage archive '%s' or index '%s'", archive, index);
+			goto fail;
+		}
+		genome_length = archive_length;
+		for (entry_t e; fread(&e, sizeof(e), 1, l->index) == 1;)
+			entry_push(l, e);
+		/* new entries go after the last whole one, the records always go at the end */
+		if (append && fseek(l->index, sizeof(lineage_header_t) + (l->count * sizeof(entry_t)), SEEK_SET) < 0)
+			goto fail;
+	}
+	l->genome_length = genome_length;
+	l->indices = allocate(sizeof(l->indices[0]) * genome_length);
+	l->values  = allocate(sizeof(l->values[0]) * genome_length);
+	return l;
+fail:
+	lineage_close(l);
+	return NULL;
+}
+
+lineage_t *lineage_open(const char *archive, const char *index, size_t genome_length, bool write) {
+	return lineage_new(archive, index, genome_length, write, false);
+}
+
+lineage_t *lineage_append(const char *archive, const char *index, size_t genome_length) {
+	return lineage_new(archive, index, genome_length, true, true);
+}
+
+int lineage_flush(lineage_t *l) {
+	assert(l);
+	if (!l->write)
+		return 0;
+	const int a = fflush(l->archive), i = fflush(l->index);
+	return a < 0 || i < 0 ? -1 : 0;
+}
+
+int lineage_close(lineage_t *l) {
+	if (!l)
+		return 0;
+	int r = 0;
+	if (l->archive && fclose(l->archive) < 0)
+		r = -1;
+	if (l->index && fclose(l->index) < 0)
+		r = -1;
+	free(l->entries);
+	free(l->indices);
+	free(l->values);
+	free(l);
+	return r;
+}
+
+uint64_t lineage_add(lineage_t *l, unsigned generation, const double *genome, uint64_t a, uint64_t b, const double *base) {
+	assert(l && l->write && genome);
+	assert(a <= l->count && b <= l->count);
+	const size_t length = l->genome_length;
+	record_t r = { .id = l->count + 1, .a = a, .b = b, .generation = generation };
+	entry_t e = { .generation = generation };
+	bool keyframe = !a || !base || l->entries[a - 1].depth >= lineage_keyframe_interval;
+	if (!keyframe) {
+		for (size_t i = 0; i < length; i++) {
+			if (genome[i] == base[i])
+				continue;
+			l->indices[r.count] = i;
+			l->values[r.count++] = genome[i];
+		}
+		keyframe = (r.count * (sizeof(l->indices[0]) + sizeof(l->values[0]))) >= (length * sizeof(genome[0]));
+		e.depth = l->entries[a - 1].depth + 1;
+	}
+	if (keyframe) {
+		r.count = length;
+		e.depth = 0;
+	}
+	if (fseek(l->archive, 0, SEEK_END) < 0)
+		goto fail;
+	const long offset = ftell(l->archive);
+	if (offset < 0 || fwrite(&r, sizeof(r), 1, l->archive) != 1)
+		goto fail;
+	if (keyframe) {
+		if (fwrite(genome, sizeof(genome[0]), length, l->archive) != length)
+			goto fail;
+	} else if (fwrite(l->indices, sizeof(l->indices[0]), r.count, l->archive) != r.count ||
+			fwrite(l->values, sizeof(l->values[0]), r.count, l->archive) != r.count) {
+		goto fail;
+	}
+	e.offset = offset;
+	if (fwrite(&e, sizeof(e), 1, l->index) != 1)
+		goto fail;
+	entry_push(l, e);
+	return r.id;
+fail:
+	warning("lineage archive write failed");
+	return 0;
+}
+
+static int record_read(lineage_t *l, uint64_t id, record_t *r) {
+	assert(l && r);
+	if (!id || id > l->count)
+		return -1;
+	if (fseek(l->archive, l->entries[id - 1].offset, SEEK_SET) < 0 || fread(r, sizeof(*r), 1, l->archive) != 1 || r->id != id)
+		return -1;
+	return 0;
+}
+
+long lineage_genome(lineage_t *l, uint64_t id, double *genome) {
+	assert(l && genome);
+	record_t r;
+	if (record_read(l, id, &r) < 0)
+		return -1;
+	const size_t length = l->genome_length;
+	if (!l->entries[id - 1].depth) {
+		if (r.count != length || fread(genome, sizeof(genome[0]), length, l->archive) != length)
+			return -1;
+		return length;
+	}
+	if (lineage_genome(l, r.a, genome) < 0)
+		return -1;
+	if (record_read(l, id, &r) < 0 || r.count > length)
+		return -1;
+	if (fread(l->indices, sizeof(l->indices[0]), r.count, l->archive) != r.count ||
+			fread(l->values, sizeof(l->values[0]), r.count, l->archive) != r.count)
+		return -1;
+	for (size_t i = 0; i < r.count; i++) {
+		if (l->indices[i] >= length)
+			return -1;
+		genome[l->indices[i]] = l->values[i];
+	}
+	return r.count;
+}
+
+int lineage_parents(lineage_t *l, uint64_t id, uint64_t *a, uint64_t *b, unsigned *generation) {
+	assert(l && a && b && generation);
+	record_t r;
+	if (record_read(l, id, &r) < 0)
+		return -1;
+	*a = r.a;
+	*b = r.b;
+	*generation = r.generation;
+	return 0;
+}
+
+uint64_t lineage_count(const lineage_t *l) {
+	assert(l);
+	return l->count;
+}
+
+size_t lineage_genome_length(const lineage_t *l) {
+	assert(l);
+	return l->genome_length;
+}
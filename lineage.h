@@ -0,0 +1,43 @@
+/** @file       lineage.h
+ *  @brief      An append only archive of every genome and its parents
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com*/
+
+#ifndef LINEAGE_H
+#define LINEAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct lineage_t;
+typedef struct lineage_t lineage_t;
+
+/** Open an archive and its index, when writing any existing archive is
+ * replaced, when reading the genome length comes from the archive. */
+lineage_t *lineage_open(const char *archive, const char *index, size_t genome_length, bool write);
+
+/** Open an existing archive and its index to carry on adding to them, the
+ * genome length must match the one in the archive */
+lineage_t *lineage_append(const char *archive, const char *index, size_t genome_length);
+
+/** Write out anything buffered, so that the archive holds every genome
+ * added so far if the program stops without closing it */
+int lineage_flush(lineage_t *l);
+int lineage_close(lineage_t *l);
+
+/** Append a genome, returning its id (ids start at one). 'a' and 'b' are the
+ * ids of its parents, zero if it has none. If 'base' is not NULL it is the
+ * genome of parent 'a' and only the parameters that differ from it are
+ * stored. Returns zero on failure. */
+uint64_t lineage_add(lineage_t *l, unsigned generation, const double *genome, uint64_t a, uint64_t b, const double *base);
+
+/** Rebuild the genome with the given id, returns the number of parameters
+ * stored for it or negative on failure */
+long lineage_genome(lineage_t *l, uint64_t id, double *genome);
+int lineage_parents(lineage_t *l, uint64_t id, uint64_t *a, uint64_t *b, unsigned *generation);
+uint64_t lineage_count(const lineage_t *l);
+size_t lineage_genome_length(const lineage_t *l);
+
+#endif
@@ -25,6 +25,17 @@
 #include "player.h"
 #include "vars.h"
 #include "gui.h"
+#include "worker.h"
+#include "service.h"
+#include "bench.h"
+#include "schedule.h"
+#include "parallel.h"
+#include "cache.h"
+#include "hall.h"
+#include "es.h"
+#include "rank.h"
+#include "lineage.h"
+#include "snapshot.h"
 #include <assert.h>
 #include <ctype.h>
 #include <float.h>
@@ -35,16 +46,40 @@
 #include <string.h>
 #include <limits.h>
 
-#define WORLD_FILE  ("gladiator.lsp")
+#define WORLD_FILE  ("gladiator.bin")
+#define WORLD_EXPORT_FILE ("gladiator.lsp")
+#define SERVICE_SOCKET ("gladiator.sock")
+#define LINEAGE_FILE   ("gladiator.lin")
+#define LINEAGE_INDEX  ("gladiator.lix")
 #define PLAYER_TEAM (UINT_MAX - 4096)
 
 typedef struct {
-	gladiator_t **gs;
+	double min, max, mean;
+	size_t champion; /* most wins, ties are broken on fitness */
+} population_statistics_t;
+
+typedef struct world_t {
+	gladiator_t **gs; /* gladiators in the current match */
 	gladiator_t **population;
+	gladiator_t **offspring; /* next generation, swapped with the population */
+	double *fitness;         /* fitness of the population, by index, at the end of a generation */
+	population_statistics_t statistics;
 	projectile_t **ps;
 	food_t **fs;
 	player_t *player;
-	size_t gladiator_count;
+	schedule_t *schedule;
+	cache_t *cache;           /* results of matches run by the workers */
+	uint64_t evaluation_seed; /* mixed into every cached match */
+	hall_t *hall;             /* past champions */
+	worker_pool_t *pool;      /* the workers running matches, if any, not owned */
+	struct world_t *hall_arena; /* plays the population against the hall in process */
+	uint64_t hall_seed;
+	es_t *es;                 /* the optimizer when using an evolution strategy */
+	lineage_t *lineage;
+	double generation_start;  /* wall clock time */
+	size_t population_count;
+	size_t gladiator_count; /* maximum number of gladiators in a match */
+	size_t match_size;      /* number of gladiators in the current match */
 	size_t gladiator_rounds;
 	size_t projectile_count;
 	size_t food_count;
@@ -53,6 +88,7 @@ typedef struct {
 
 	unsigned round;
 	unsigned match;
+	prng_t match_prng; /* PRNG state before the current match was set up */
 
 	bool player_fire;
 	bool player_forward;
@@ -61,49 +97,77 @@ typedef struct {
 
 	unsigned tick, next;
 	bool step, skip;
+	double max_ticks; /* tick budget for the current match */
+
+	bool stalemate;
+	unsigned stalemate_start;
+	unsigned stalemate_hits;
 } world_t;
 
 world_t *world;
 
-static cell_t *world_serialize(world_t *w) {
-	assert(w);
+static void world_serialize(world_t *w, emitter_t *e) {
+	assert(w && e);
 	cell_t *configuration = config_serialize();
-	cell_t *gladiators = cons(mksym("gladiators"), nil());
-	cell_t *op   = gladiators;
-	for (size_t i = 0; i < w->gladiator_count * (1 << w->gladiator_rounds); op = cdr(op), i++)
-		setcdr(op, cons(gladiator_serialize(w->population[i]), nil()));
-	cell_t *projectiles = cons(mksym("projectiles"), nil());
-	op = projectiles;
-	for (size_t i = 0; i < w->projectile_count; op = cdr(op), i++)
-		setcdr(op, cons(projectile_serialize(w->ps[i]), nil()));
-	cell_t *foods = cons(mksym("foods"), nil());
-	op = foods;
-	for (size_t i = 0; i < w->food_count; op = cdr(op), i++)
-		setcdr(op, cons(food_serialize(w->fs[i]), nil()));
-	cell_t *c = printer(
-			"world %x %x %x %x %x"
-			"(gladiator-count %d) "
-			"(gladiator-rounds %d) "
-			"(projectile-count %d) "
-			"(food-count %d) "
-			"(generation %d) "
-			"(alive %d) "
-			"(tick %d) "
-			"(round %d) "
-			"(match %d) "
-			,
-			configuration, gladiators, projectiles, foods, player_serialize(w->player),
-			(intptr_t)(w->gladiator_count),
-			(intptr_t)(w->gladiator_rounds),
-			(intptr_t)(w->projectile_count),
-			(intptr_t)(w->food_count),
-			(intptr_t)(w->generation),
-			(intptr_t)(w->alive),
-			(intptr_t)(w->tick),
-			(intptr_t)(w->round),
-			(intptr_t)(w->match)
-			);
-	return c;
+	emit_begin(e);
+	emit_symbol(e, "world");
+	emit_cell(e, configuration);
+	cell_delete(configuration);
+	emit_begin(e);
+	emit_symbol(e, "gladiators");
+	for (size_t i = 0; i < w->population_count; i++)
+		gladiator_serialize(w->population[i], e);
+	emit_end(e);
+	emit_begin(e);
+	emit_symbol(e, "projectiles");
+	for (size_t i = 0; i < w->projectile_count; i++)
+		projectile_serialize(w->ps[i], e);
+	emit_end(e);
+	emit_begin(e);
+	emit_symbol(e, "foods");
+	for (size_t i = 0; i < w->food_count; i++)
+		food_serialize(w->fs[i], e);
+	emit_end(e);
+	player_serialize(w->player, e);
+	emit_item_integer(e, "gladiator-count",  w->gladiator_count);
+	emit_item_integer(e, "gladiator-rounds", w->gladiator_rounds);
+	emit_item_integer(e, "projectile-count", w->projectile_count);
+	emit_item_integer(e, "food-count",       w->food_count);
+	emit_item_integer(e, "generation",       w->generation);
+	emit_item_integer(e, "alive",            w->alive);
+	emit_item_integer(e, "tick",             w->tick);
+	emit_item_integer(e, "round",            w->round);
+	emit_item_integer(e, "match",            w->match);
+	emit_end(e);
+}
+
+/* A knockout tournament is a form of successive halving; only the top half
+ * of the gladiators go through to the next round, so the early rounds can be used
+ * to screen out the worst of the gladiators with shorter matches, saving the
+ * full tick budget for the later rounds in which fewer matches are played.
+ * Every gladiator plays every round of the other formats, so they all get
+ * the full budget. */
+static double round_max_ticks(const schedule_t *s) {
+	assert(s);
+	if (arena_tournament_method != SCHEDULE_KNOCKOUT)
+		return max_ticks_per_generation;
+	const unsigned remaining = schedule_rounds(s) - schedule_round(s);
+	const double budget = max_ticks_per_generation / pow(max_ticks_round_growth, remaining - 1);
+	return MIN(max_ticks_per_generation, MAX(min_ticks_per_match, budget));
+}
+
+static void match_setup(world_t *w);
+static void hall_of_fame_benchmark(world_t *w, FILE *out);
+static void hall_of_fame_update(world_t *w);
+static void world_delete(world_t *w);
+
+/* Once a loaded world has its population and arena it starts the tournament
+ * for the current generation from the beginning */
+static void world_start(world_t *w) {
+	assert(w);
+	w->generation_start = wall_time();
+	w->schedule = schedule_new(arena_tournament_method, w->population_count, w->gladiator_count, w->gladiator_rounds);
+	match_setup(w);
 }
 
 static world_t *world_deserialize(cell_t *c) {
@@ -133,20 +197,24 @@ static world_t *world_deserialize(cell_t *c) {
 	}
 	if (config_deserialize(configuration) < 0)
 		goto fail;
-	const size_t total = gsc * (1ull << grnd);
-	if (gsc)
-		w->population = allocate(sizeof(*gs) * total);
-	w->gs = w->population;
+	const size_t total = type(gs) == CONS ? cell_length(gs) - 1 : 0;
+	if (gsc < 2 || total < gsc) {
+		warning("invalid gladiator count or population size");
+		goto fail;
+	}
+	w->population = allocate(sizeof(*gs) * total);
+	w->offspring  = allocate(sizeof(*gs) * total);
+	w->fitness    = allocate(sizeof(w->fitness[0]) * total);
+	w->gs = allocate(sizeof(*gs) * gsc);
 	if (psc)
 		w->ps = allocate(sizeof(*ps) * psc);
 	if (fsc)
 		w->fs = allocate(sizeof(*fs) * fsc);
-	if (gsc)
-		gs = cdr(gs);
+	gs = cdr(gs);
 	size_t i = 0;
 	for (i = 0 ; i < total && type(gs) != NIL; i++, gs = cdr(gs)) {
 		cell_type_e wt = type(car(gs));
-		if (wt != CONS || !(w->gs[i] = gladiator_deserialize(car(gs)))) {
+		if (wt != CONS || !(w->population[i] = gladiator_deserialize(car(gs)))) {
 			warning("gladiator deserialization failed");
 			goto fail;
 		}
@@ -179,60 +247,527 @@ static world_t *world_deserialize(cell_t *c) {
 		warning("player deserialization failed");
 		goto fail;
 	}
-	w->round = round;
-	w->match = match;
+	/* The position within the tournament is not saved, the tournament for
+	 * the current generation is started again */
+	UNUSED(round);
+	UNUSED(match);
+	UNUSED(alive);
+	UNUSED(tick);
 	w->gladiator_rounds = grnd;
 	w->gladiator_count = gsc;
+	w->population_count = total;
 	w->projectile_count = psc;
 	w->food_count = fsc;
 	w->generation = generation;
-	w->alive = alive;
-	w->tick = tick;
-	w->gs = w->population + (match * gsc);
+	world_start(w);
 	return w;
 fail:
 	return NULL;
 }
 
-static int world_save(world_t *w, const char *file) {
+static int world_save_s_expression(world_t *w, const char *file) {
 	if (!w)
 		return 0;
-	int r = -1;
-	cell_t *c = NULL;
-	FILE *f = NULL;
-	if (!world)
-		goto fail;
-	c = world_serialize(w);
-	if (!c)
-		goto fail;
-	f = fopen(file, "wb");
+	FILE *f = fopen(file, "wb");
 	if (!f)
-		goto fail;
-	r = write_s_expression_to_file(c, f);
-fail:
-	cell_delete(c);
-	if (f)
-		fclose(f);
-	return r;
+		return -1;
+	emitter_t *e = emitter_new(f);
+	world_serialize(w, e);
+	const long r = emitter_delete(e);
+	if (fclose(f) < 0 || r < 0)
+		return -1;
+	return 0;
 }
 
-static world_t *world_load(const char *file) {
+static world_t *world_load_s_expression(const char *file) {
 	world_t *w = NULL;
-	FILE *f = NULL;
-	cell_t *c = NULL;
-	f = fopen(file, "rb");
-	if (!f)
+	cell_arena_t *a = cell_arena_new();
+	cell_t *c = read_s_expression_from_path(file, a);
+	if (c)
+		w = world_deserialize(c);
+	cell_arena_delete(a);
+	return w;
+}
+
+/* Section types and records of a world snapshot, each record field is a
+ * 64-bit word so the records can be used straight from the file. Bump
+ * the version in 'snapshot.c' if any of these change. */
+enum {
+	SNAPSHOT_CONFIG = 1,
+	SNAPSHOT_WORLD,
+	SNAPSHOT_PRNG,
+	SNAPSHOT_GLADIATORS,
+	SNAPSHOT_GENOMES,
+	SNAPSHOT_PROJECTILES,
+	SNAPSHOT_FOODS,
+	SNAPSHOT_PLAYER,
+	SNAPSHOT_RUN,
+	SNAPSHOT_SCHEDULE,
+	SNAPSHOT_BRAINS,
+	SNAPSHOT_HALL,
+	SNAPSHOT_ES,
+	SNAPSHOT_MUTATIONS,
+};
+
+typedef struct {
+	uint64_t name; /* hash of the item name */
+	double value;
+} snapshot_config_t;
+
+typedef struct {
+	uint64_t gladiator_count, gladiator_rounds, population, projectile_count, food_count;
+	uint64_t generation, genome_length;
+} snapshot_world_t;
+
+typedef struct {
+	double x, y, orientation, field_of_view, health, energy, fitness, benchmark;
+	uint64_t team, hits, foods, fired, mutations, id;
+	uint64_t round, time_alive, refire_timeout, wall_contact, stalemate;
+} snapshot_gladiator_t;
+
+typedef struct {
+	double x, y, orientation, travelled;
+	uint64_t team;
+} snapshot_projectile_t;
+
+typedef struct {
+	double x, y, orientation;
+	uint64_t eaten;
+} snapshot_food_t;
+
+typedef struct {
+	double x, y, orientation, health, energy, score;
+	uint64_t team, hits, foods;
+} snapshot_player_t;
+
+/* Everything else needed to carry on a run exactly; the parts of the world
+ * that are only made once they are first needed are flagged as present, the
+ * PRNG state is the one from before the current match was set up. */
+enum {
+	SNAPSHOT_RUN_CACHE = 1 << 0,
+	SNAPSHOT_RUN_HALL  = 1 << 1,
+	SNAPSHOT_RUN_ES    = 1 << 2,
+};
+
+typedef struct {
+	uint64_t digest; /* of the configuration */
+	uint64_t flags;
+	uint64_t match, evaluation_seed, hall_seed, hall_next, es_seed;
+} snapshot_run_t;
+
+static uint64_t config_item_hash(const char *name) {
+	return hash64(name, strlen(name), 0);
+}
+
+/* Items that control how a run is carried out, and not what it does, are
+ * always taken from the current configuration so that a run loaded from a
+ * snapshot can be extended, checkpointed differently or watched. Matches
+ * are run differently in process than by workers, so moving a run between
+ * no workers and some workers changes it, the number of workers does not. */
+static bool config_item_is_run_control(const char *name) {
+	static const char *prefixes[] = { "print_", "draw_", "window_", "world_" };
+	static const char *names[] = {
+		"arena_paused", "arena_tick_ms", "lineage_archive_on", "lineage_keyframe_interval",
+		"program_breeding_threads", "program_headless_loops", "program_log_level",
+		"program_pause_after_new_generation", "program_run_headless",
+		"program_run_window_after_headless", "program_worker_processes",
+	};
+	for (size_t i = 0; i < sizeof(prefixes)/sizeof(prefixes[0]); i++)
+		if (!strncmp(name, prefixes[i], strlen(prefixes[i])))
+			return true;
+	for (size_t i = 0; i < sizeof(names)/sizeof(names[0]); i++)
+		if (!strcmp(name, names[i]))
+			return true;
+	return false;
+}
+
+/* A hash of the name and value of every configuration item that decides
+ * what a run does, two runs with the same digest carry on the same way */
+static uint64_t config_digest(void) {
+	const size_t items = config_items();
+	uint64_t digest = 0;
+	for (size_t i = 0; i < items; i++) {
+		if (config_item_is_run_control(config_item_name(i)))
+			continue;
+		const snapshot_config_t c = { config_item_hash(config_item_name(i)), config_item_get(i) };
+		digest = hash64(&c, sizeof(c), digest);
+	}
+	return digest;
+}
+
+/* The world is copied into the records of a snapshot in the foreground, if
+ * 'background' is set the file is then written on a background thread. */
+static int world_save_snapshot(world_t *w, const char *file, bool background) {
+	if (!w)
+		return 0;
+	const size_t items = config_items(), length = gladiator_genome_length();
+	const size_t states = brain_state_length(w->population[0]->brain);
+	const size_t neurons = brain_neurons(w->population[0]->brain);
+	const size_t halls = w->hall ? hall_count(w->hall) : 0;
+	snapshot_config_t *config = allocate(sizeof(config[0]) * items);
+	snapshot_gladiator_t *gs = allocate(sizeof(gs[0]) * w->population_count);
+	double *genomes = allocate(sizeof(genomes[0]) * w->population_count * length);
+	double *brains = allocate(sizeof(brains[0]) * w->population_count * states);
+	uint64_t *mutations = allocate(sizeof(mutations[0]) * w->population_count * neurons);
+	snapshot_projectile_t *ps = allocate(sizeof(ps[0]) * (w->projectile_count + 1));
+	snapshot_food_t *fs = allocate(sizeof(fs[0]) * (w->food_count + 1));
+	uint64_t *schedule = allocate(sizeof(schedule[0]) * schedule_state_length(w->schedule));
+	uint64_t *hall = allocate(sizeof(hall[0]) * (halls + 1) * (1 + length));
+	for (size_t i = 0; i < items; i++)
+		config[i] = (snapshot_config_t) { config_item_hash(config_item_name(i)), config_item_get(i) };
+	const snapshot_world_t world = {
+		.gladiator_count  = w->gladiator_count,
+		.gladiator_rounds = w->gladiator_rounds,
+		.population       = w->population_count,
+		.projectile_count = w->projectile_count,
+		.food_count       = w->food_count,
+		.generation       = w->generation,
+		.genome_length    = length,
+	};
+	const snapshot_run_t run = {
+		.digest = config_digest(),
+		.flags  = (w->cache ? SNAPSHOT_RUN_CACHE : 0) | (w->hall ? SNAPSHOT_RUN_HALL : 0) | (w->es ? SNAPSHOT_RUN_ES : 0),
+		.match  = w->match,
+		.evaluation_seed = w->evaluation_seed,
+		.hall_seed = w->hall_seed,
+		.hall_next = w->hall ? hall_next(w->hall) : 0,
+		.es_seed   = w->es ? es_seed(w->es) : 0,
+	};
+	for (size_t i = 0; i < w->population_count; i++) {
+		const gladiator_t *g = w->population[i];
+		gs[i] = (snapshot_gladiator_t) {
+			.x = g->x, .y = g->y, .orientation = g->orientation,
+			.field_of_view = g->field_of_view, .health = g->health, .energy = g->energy,
+			.fitness = g->fitness, .benchmark = g->benchmark,
+			.team = g->team, .hits = g->hits, .foods = g->foods, .fired = g->fired,
+			.mutations = g->mutations, .id = g->id,
+			.round = g->round, .time_alive = g->time_alive, .refire_timeout = g->refire_timeout,
+			.wall_contact = g->wall_contact_timer.i, .stalemate = g->stalemate,
+		};
+		assert(brain_genome_length(g->brain) == length);
+		brain_genome_export(g->brain, &genomes[i * length]);
+		brain_state_export(g->brain, &brains[i * states]);
+		brain_mutations_export(g->brain, &mutations[i * neurons]);
+	}
+	for (size_t i = 0; i < w->projectile_count; i++) {
+		const projectile_t *p = w->ps[i];
+		ps[i] = (snapshot_projectile_t) { p->x, p->y, p->orientation, p->travelled, p->team };
+	}
+	for (size_t i = 0; i < w->food_count; i++) {
+		const food_t *f = w->fs[i];
+		fs[i] = (snapshot_food_t) { f->x, f->y, f->orientation, f->eaten };
+	}
+	const player_t *p = w->player;
+	const snapshot_player_t player = {
+		p->x, p->y, p->orientation, p->health, p->energy, p->score, p->team, p->hits, p->foods
+	};
+	schedule_state_export(w->schedule, schedule);
+	for (size_t i = 0; i < halls; i++) {
+		hall[i * (1 + length)] = hall_hash(w->hall, i);
+		memcpy(&hall[(i * (1 + length)) + 1], hall_genome(w->hall, i), sizeof(double) * length);
+	}
+
+	snapshot_t *s = snapshot_new();
+	int r = 0;
+	r |= snapshot_section_add(s, SNAPSHOT_CONFIG,      config,  items, sizeof(config[0]));
+	r |= snapshot_section_add(s, SNAPSHOT_WORLD,       &world,  1, sizeof(world));
+	r |= snapshot_section_add(s, SNAPSHOT_PRNG,        &w->match_prng, 1, sizeof(w->match_prng));
+	r |= snapshot_section_add(s, SNAPSHOT_GLADIATORS,  gs,      w->population_count, sizeof(gs[0]));
+	r |= snapshot_section_add(s, SNAPSHOT_GENOMES,     genomes, w->population_count, sizeof(genomes[0]) * length);
+	r |= snapshot_section_add(s, SNAPSHOT_PROJECTILES, ps,      w->projectile_count, sizeof(ps[0]));
+	r |= snapshot_section_add(s, SNAPSHOT_FOODS,       fs,      w->food_count, sizeof(fs[0]));
+	r |= snapshot_section_add(s, SNAPSHOT_PLAYER,      &player, 1, sizeof(player));
+	r |= snapshot_section_add(s, SNAPSHOT_RUN,         &run,    1, sizeof(run));
+	r |= snapshot_section_add(s, SNAPSHOT_SCHEDULE,    schedule, schedule_state_length(w->schedule), sizeof(schedule[0]));
+	r |= snapshot_section_add(s, SNAPSHOT_BRAINS,      brains,  w->population_count, sizeof(brains[0]) * states);
+	r |= snapshot_section_add(s, SNAPSHOT_MUTATIONS,   mutations, w->population_count, sizeof(mutations[0]) * neurons);
+	r |= snapshot_section_add(s, SNAPSHOT_HALL,        hall,    halls, sizeof(hall[0]) * (1 + length));
+	if (w->es)
+		r |= snapshot_section_add(s, SNAPSHOT_ES, es_center(w->es), 1, sizeof(double) * length);
+	if (r == 0)
+		r = background ? snapshot_write_background(s, file) : snapshot_write(s, file);
+	snapshot_delete(s);
+	free(config);
+	free(gs);
+	free(genomes);
+	free(brains);
+	free(mutations);
+	free(ps);
+	free(fs);
+	free(schedule);
+	free(hall);
+	return r < 0 ? -1 : 0;
+}
+
+static int snapshot_config_load(const snapshot_config_t *config, size_t count) {
+	const size_t items = config_items();
+	for (size_t i = 0; i < count; i++) {
+		size_t j = 0;
+		for (j = 0; j < items; j++)
+			if (config_item_hash(config_item_name(j)) == config[i].name)
+				break;
+		if (j == items) {
+			warning("unknown configuration item in snapshot");
+			return -1;
+		}
+		if (config_item_is_run_control(config_item_name(j)))
+			continue;
+		if (config_item_set(config_item_name(j), config[i].value) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/* The parts of a run that are made when they are first needed are put back
+ * as they were, along with the tournament, so that the run carries on as if
+ * it had never stopped. */
+static int world_resume(world_t *w, const snapshot_t *s, const snapshot_run_t *run) {
+	assert(w && s && run);
+	const size_t length = gladiator_genome_length();
+	size_t nschedule = 0, nhall = 0, nes = 0;
+	const uint64_t *schedule = snapshot_section(s, SNAPSHOT_SCHEDULE, sizeof(*schedule), &nschedule);
+	const uint64_t *hall     = snapshot_section(s, SNAPSHOT_HALL, sizeof(*hall) * (1 + length), &nhall);
+	const double *center     = snapshot_section(s, SNAPSHOT_ES, sizeof(*center) * length, &nes);
+	if (!schedule || schedule_state_import(w->schedule, schedule, nschedule) < 0 || run->match >= schedule_matches(w->schedule)) {
+		warning("snapshot tournament does not fit the configuration");
+		return -1;
+	}
+	w->match = run->match;
+	if ((run->flags & SNAPSHOT_RUN_CACHE) && evaluation_cache_entries) {
+		w->cache = cache_new(evaluation_cache_entries, 1 + (GLADIATOR_STATE_LAST * w->gladiator_count));
+		w->evaluation_seed = run->evaluation_seed;
+	}
+	if ((run->flags & SNAPSHOT_RUN_HALL) && hall_of_fame_size) {
+		if (nhall > hall_of_fame_size || run->hall_next >= hall_of_fame_size) {
+			warning("snapshot hall of fame does not fit the configuration");
+			return -1;
+		}
+		w->hall = hall_new(hall_of_fame_size, length);
+		w->hall_seed = run->hall_seed;
+		double *genome = allocate(sizeof(genome[0]) * length);
+		for (size_t i = 0; i < nhall; i++) {
+			memcpy(genome, &hall[(i * (1 + length)) + 1], sizeof(genome[0]) * length);
+			(void)hall_add(w->hall, hall[i * (1 + length)], genome);
+		}
+		free(genome);
+		hall_set_next(w->hall, run->hall_next);
+	}
+	if (run->flags & SNAPSHOT_RUN_ES) {
+		if (!center || nes != 1) {
+			warning("snapshot is missing its evolution strategy");
+			return -1;
+		}
+		w->es = es_new(center, length, w->population_count / 2, evolution_strategy_sigma, evolution_strategy_learning_rate);
+		es_sample(w->es, run->es_seed, program_breeding_threads);
+	}
+	return 0;
+}
+
+static world_t *world_load_snapshot(const char *file) {
+	snapshot_t *s = snapshot_open(file);
+	if (!s)
+		return NULL;
+	world_t *w = NULL;
+	size_t nconfig = 0, nworld = 0, nprng = 0, nrun = 0, ngs = 0, ngenomes = 0, nbrains = 0, nmutations = 0, nps = 0, nfs = 0, nplayer = 0;
+	const snapshot_config_t *config = snapshot_section(s, SNAPSHOT_CONFIG, sizeof(*config), &nconfig);
+	const snapshot_world_t *world   = snapshot_section(s, SNAPSHOT_WORLD, sizeof(*world), &nworld);
+	const prng_t *prng              = snapshot_section(s, SNAPSHOT_PRNG, sizeof(*prng), &nprng);
+	const snapshot_run_t *run       = snapshot_section(s, SNAPSHOT_RUN, sizeof(*run), &nrun);
+	if (!config || !world || nworld != 1 || !prng || nprng != 1 || !run || nrun != 1) {
+		warning("snapshot '%s' is missing its configuration or world", file);
 		goto fail;
-	setvbuf(f, NULL, _IONBF, 0);
-	c = read_s_expression_from_file(f);
-	if (!c)
+	}
+	if (run->digest != config_digest()) { /* only set the configuration if it differs */
+		note("snapshot '%s' has a different configuration, using the one in the snapshot apart from how the run is carried out", file);
+		if (snapshot_config_load(config, nconfig) < 0)
+			goto fail;
+		if (run->digest != config_digest())
+			warning("snapshot '%s' does not set every configuration item, the run will not carry on exactly", file);
+	}
+	const size_t length = gladiator_genome_length();
+	if (world->genome_length != length) {
+		warning("snapshot genome length %llu does not match the configuration (%zu)", (unsigned long long)world->genome_length, length);
 		goto fail;
-	w = world_deserialize(c);
-fail:
-	cell_delete(c);
-	if (f)
-		fclose(f);
+	}
+	const snapshot_gladiator_t *gs   = snapshot_section(s, SNAPSHOT_GLADIATORS, sizeof(*gs), &ngs);
+	const double *genomes            = snapshot_section(s, SNAPSHOT_GENOMES, sizeof(*genomes) * length, &ngenomes);
+	const snapshot_projectile_t *ps  = snapshot_section(s, SNAPSHOT_PROJECTILES, sizeof(*ps), &nps);
+	const snapshot_food_t *fs        = snapshot_section(s, SNAPSHOT_FOODS, sizeof(*fs), &nfs);
+	const snapshot_player_t *player  = snapshot_section(s, SNAPSHOT_PLAYER, sizeof(*player), &nplayer);
+	if (world->gladiator_count < 2 || world->population < world->gladiator_count
+			|| !gs || ngs != world->population || !genomes || ngenomes != world->population
+			|| nps != world->projectile_count || nfs != world->food_count || !player || nplayer != 1) {
+		warning("snapshot '%s' has inconsistent sections", file);
+		goto fail;
+	}
+
+	w = allocate(sizeof(*w));
+	w->gladiator_count  = world->gladiator_count;
+	w->gladiator_rounds = world->gladiator_rounds;
+	w->population_count = world->population;
+	w->projectile_count = world->projectile_count;
+	w->food_count       = world->food_count;
+	w->generation       = world->generation;
+	w->population = allocate(sizeof(w->population[0]) * w->population_count);
+	w->offspring  = allocate(sizeof(w->offspring[0]) * w->population_count);
+	w->fitness    = allocate(sizeof(w->fitness[0]) * w->population_count);
+	w->gs         = allocate(sizeof(w->gs[0]) * w->gladiator_count);
+	for (size_t i = 0; i < w->population_count; i++) {
+		const snapshot_gladiator_t *r = &gs[i];
+		if (r->x < Xmin || r->x > Xmax || r->y < Ymin || r->y > Ymax) {
+			warning("snapshot gladiator %zu is out of bounds", i);
+			goto fail;
+		}
+		gladiator_t *g = gladiator_new_with_genome(r->team, r->x, r->y, r->orientation, &genomes[i * length]);
+		g->field_of_view = r->field_of_view;
+		g->health    = r->health;
+		g->energy    = r->energy;
+		g->fitness   = r->fitness;
+		g->benchmark = r->benchmark;
+		g->hits      = r->hits;
+		g->foods     = r->foods;
+		g->fired     = r->fired;
+		g->mutations = r->mutations;
+		g->id        = r->id;
+		g->round          = r->round;
+		g->time_alive     = r->time_alive;
+		g->refire_timeout = r->refire_timeout;
+		g->wall_contact_timer.i = r->wall_contact;
+		g->stalemate      = r->stalemate;
+		w->population[i] = g;
+	}
+	const size_t states = brain_state_length(w->population[0]->brain), neurons = brain_neurons(w->population[0]->brain);
+	const double *brains      = snapshot_section(s, SNAPSHOT_BRAINS, sizeof(*brains) * states, &nbrains);
+	const uint64_t *mutations = snapshot_section(s, SNAPSHOT_MUTATIONS, sizeof(*mutations) * neurons, &nmutations);
+	if (!brains || nbrains != w->population_count || !mutations || nmutations != w->population_count) {
+		warning("snapshot '%s' has inconsistent sections", file);
+		goto fail;
+	}
+	for (size_t i = 0; i < w->population_count; i++) {
+		brain_state_import(w->population[i]->brain, &brains[i * states]);
+		brain_mutations_import(w->population[i]->brain, &mutations[i * neurons]);
+	}
+	if (w->projectile_count)
+		w->ps = allocate(sizeof(w->ps[0]) * w->projectile_count);
+	for (size_t i = 0; i < w->projectile_count; i++) {
+		projectile_t *p = projectile_new(ps[i].team, 0, 0, 0);
+		p->x = ps[i].x;
+		p->y = ps[i].y;
+		p->orientation = ps[i].orientation;
+		p->travelled = ps[i].travelled;
+		w->ps[i] = p;
+	}
+	if (w->food_count)
+		w->fs = allocate(sizeof(w->fs[0]) * w->food_count);
+	for (size_t i = 0; i < w->food_count; i++) {
+		w->fs[i] = food_new(fs[i].x, fs[i].y, fs[i].orientation);
+		w->fs[i]->eaten = fs[i].eaten;
+	}
+	w->player = player_new(player->team);
+	w->player->x           = player->x;
+	w->player->y           = player->y;
+	w->player->orientation = player->orientation;
+	w->player->health      = player->health;
+	w->player->energy      = player->energy;
+	w->player->score       = player->score;
+	w->player->hits        = player->hits;
+	w->player->foods       = player->foods;
+	w->generation_start = wall_time();
+	w->schedule = schedule_new(arena_tournament_method, w->population_count, w->gladiator_count, w->gladiator_rounds);
+	if (world_resume(w, s, run) < 0)
+		goto fail;
+	random_method(program_random_method);
+	random_state_set(prng);
+	match_setup(w);
+	snapshot_delete(s);
 	return w;
+fail:
+	if (w && w->population) {
+		for (size_t i = 0; i < w->population_count; i++)
+			if (w->population[i])
+				gladiator_delete(w->population[i]);
+		free(w->population);
+		free(w->offspring);
+		free(w->fitness);
+		free(w->gs);
+		schedule_delete(w->schedule);
+		cache_delete(w->cache);
+		hall_delete(w->hall);
+		es_delete(w->es);
+	}
+	free(w);
+	snapshot_delete(s);
+	return NULL;
+}
+
+/* The format is chosen by the file extension, '.lsp' files are S-Expressions
+ * and anything else is a binary snapshot */
+static bool is_s_expression_file(const char *file) {
+	assert(file);
+	static const char extension[] = ".lsp";
+	const size_t length = strlen(file);
+	return length >= sizeof(extension) - 1 && !strcmp(file + length - (sizeof(extension) - 1), extension);
+}
+
+static int world_save(world_t *w, const char *file) {
+	return is_s_expression_file(file) ? world_save_s_expression(w, file) : world_save_snapshot(w, file, false);
+}
+
+/* A checkpoint of the world is written at the end of a generation every
+ * 'world_checkpoint_generations' generations, or once 'world_checkpoint_seconds'
+ * have passed since the last one, so a long run that dies loses little. The
+ * world is copied quickly and written out in the background, if the last
+ * checkpoint is still being written this one is skipped rather than waited
+ * for, the next generation will try again. */
+static void world_checkpoint(world_t *w) {
+	assert(w);
+	static bool started = false;
+	static unsigned generation = 0;
+	static double last = 0;
+	const double now = wall_time();
+	if (!started) { /* count from the generation this run started at, which may be a resumed one */
+		started = true;
+		generation = w->generation - 1;
+		last = now;
+	}
+	const bool generations = world_checkpoint_generations && w->generation - generation >= world_checkpoint_generations;
+	const bool seconds = world_checkpoint_seconds > 0 && now - last >= world_checkpoint_seconds;
+	if (!generations && !seconds)
+		return;
+	if (w->lineage && lineage_flush(w->lineage) < 0)
+		warning("failed to flush the lineage archive");
+	if (snapshot_busy()) {
+		debug("checkpoint skipped at generation %u, the last one is still being written", w->generation);
+		return;
+	}
+	if (world_save_snapshot(w, WORLD_FILE, true) < 0) {
+		warning("checkpoint failed at generation %u", w->generation);
+		return;
+	}
+	debug("checkpoint started at generation %u", w->generation);
+	generation = w->generation;
+	last = now;
+}
+
+static world_t *world_load(const char *file) {
+	return is_s_expression_file(file) ? world_load_s_expression(file) : world_load_snapshot(file);
+}
+
+/* Converts between the binary snapshot and the S-Expression format */
+static int world_convert(const char *from, const char *to) {
+	assert(from && to);
+	world_t *w = world_load(from);
+	if (!w) {
+		warning("failed to load world from '%s'", from);
+		return -1;
+	}
+	const int r = world_save(w, to);
+	if (r < 0)
+		warning("failed to save world to '%s'", to);
+	else
+		note("converted '%s' to '%s'", from, to);
+	world_delete(w);
+	return r;
 }
 
 static double random_x(void) {
@@ -281,8 +816,8 @@ static bool detect_projectile_collision(world_t *w, gladiator_t *g, bool hits[])
 			if (pteam == PLAYER_TEAM) {
 				w->player->hits++;
 			} else {
-				assert(pteam < (w->gladiator_count * (1 << w->gladiator_rounds)));
-				w->population[pteam]->hits++;
+				assert(pteam < w->match_size);
+				w->gs[pteam]->hits++;
 			}
 			projectile_deactivate(w->ps[i]);
 			return true;
@@ -320,7 +855,7 @@ static bool detect_food_collision(world_t *w, gladiator_t *g) {
 }
 
 static bool detect_gladiator_collision(world_t *w, gladiator_t *g) {
-	for (size_t i = 0; i < w->gladiator_count; i++) {
+	for (size_t i = 0; i < w->match_size; i++) {
 		gladiator_t *enemy = w->gs[i];
 		if ((enemy->team == g->team) || gladiator_is_dead(enemy))
 			continue;
@@ -344,7 +879,7 @@ static double detection_function(double ax, double ay, double bx, double by) {
 
 static double detect_gladiator(world_t *w, gladiator_t *k, bool detect_enemy_only) {
 	assert(k);
-	for (size_t i = 0; i < w->gladiator_count; i++) {
+	for (size_t i = 0; i < w->match_size; i++) {
 		gladiator_t *c = w->gs[i];
 		assert(c);
 		if ((detect_enemy_only && (k->team == c->team)) || gladiator_is_dead(c))
@@ -485,6 +1020,48 @@ static void player_fire(player_t *pl, world_t *w, bool fire) {
 	}
 }
 
+static void stalemate_reset(world_t *w, unsigned start) {
+	assert(w);
+	w->stalemate_start = start;
+	w->stalemate_hits = 0;
+	for (size_t i = 0; i < w->match_size; i++) {
+		gladiator_t *g = w->gs[i];
+		w->stalemate_hits += g->hits;
+		g->anchor.x = g->x;
+		g->anchor.y = g->y;
+	}
+}
+
+/* A match is in a stalemate when nothing has happened for a while; no
+ * gladiator has scored a hit, there are no projectiles in flight and no
+ * gladiator has moved far from where it was at the start of the window. */
+static void update_stalemate(world_t *w) {
+	assert(w);
+	if (arena_stalemate_ticks <= 0)
+		return;
+	bool active = false;
+	unsigned hits = 0;
+	for (size_t i = 0; i < w->match_size; i++) {
+		gladiator_t *g = w->gs[i];
+		hits += g->hits;
+		if (gladiator_is_dead(g))
+			continue;
+		if (euclidean_distance(g->x, g->y, g->anchor.x, g->anchor.y) > arena_stalemate_distance)
+			active = true;
+	}
+	for (size_t i = 0; !active && i < w->projectile_count; i++)
+		active = projectile_is_active(w->ps[i]);
+	if (active || hits != w->stalemate_hits) {
+		stalemate_reset(w, w->tick);
+		return;
+	}
+	if ((w->tick - w->stalemate_start) >= arena_stalemate_ticks) {
+		w->stalemate = true;
+		for (size_t i = 0; i < w->match_size; i++)
+			w->gs[i]->stalemate = true;
+	}
+}
+
 static void update_scene(world_t *w) {
 	double inputs[GLADIATOR_IN_LAST_INPUT] = { 0 };
 	double outputs[GLADIATOR_OUT_LAST_OUTPUT] = { 0 };
@@ -498,14 +1075,14 @@ static void update_scene(world_t *w) {
 		w->player_fire = false;
 	}
 
-	for (unsigned i = 0; i < w->gladiator_count; i++)
+	for (unsigned i = 0; i < w->match_size; i++)
 		if (!gladiator_is_dead(w->gs[i]))
 			w->alive++;
-	for (unsigned i = 0; i < w->gladiator_count; i++)
+	for (unsigned i = 0; i < w->match_size; i++)
 		detect_projectile_collision(w, w->gs[i], hits);
-	for (unsigned i = 0; i < w->gladiator_count; i++)
+	for (unsigned i = 0; i < w->match_size; i++)
 		detect_food_collision(w, w->gs[i]);
-	for (unsigned i = 0; i < w->gladiator_count; i++) {
+	for (unsigned i = 0; i < w->match_size; i++) {
 		gladiator_t  *g = w->gs[i];
 		if (gladiator_is_dead(g))
 			continue;
@@ -519,6 +1096,7 @@ static void update_scene(world_t *w) {
 		projectile_update(w->ps[i]);
 	for (unsigned i = 0; i < w->food_count; i++)
 		food_update(w->fs[i]);
+	update_stalemate(w);
 }
 
 static void draw_debug_info(world_t *w) {
@@ -529,11 +1107,11 @@ static void draw_debug_info(world_t *w) {
 	fill_textbox(&t, print_generation,        "generation: %u", w->generation);
 	fill_textbox(&t, print_arena_tick,        "tick:       %u", w->tick);
 	fill_textbox(&t, print_fps,               "fps:        %f", fps());
-	fill_textbox(&t, print_gladiators_alive,  "alive:      %u/%u", w->alive, w->gladiator_count);
+	fill_textbox(&t, print_gladiators_alive,  "alive:      %u/%u", w->alive, (unsigned)w->match_size);
 	fill_textbox(&t, print_round,             "round:      %u", w->round);
 	fill_textbox(&t, print_match,             "match:      %u", w->match);
 
-	for (size_t i = 0; i < w->gladiator_count; i++) {
+	for (size_t i = 0; i < w->match_size; i++) {
 		gladiator_t *g = w->gs[i];
 		t.color_text = g->color;
 		fill_textbox(&t, print_gladiator_team_number,     "gladiator:  %u", g->team);
@@ -559,25 +1137,6 @@ static void draw_debug_info(world_t *w) {
 	draw_textbox(&t);
 }
 
-static int fitness_compare_function(const void *a, const void *b) {
-	gladiator_t *ap = *((gladiator_t**)a);
-	gladiator_t *bp = *((gladiator_t**)b);
-	if (ap->fitness >  bp->fitness) return -1;
-	if (ap->fitness == bp->fitness) return  0;
-	if (ap->fitness <  bp->fitness) return  1;
-	return 0;
-}
-
-static void update_fitness(gladiator_t **gs, size_t count) {
-	for (size_t i = 0; i < count; i++)
-		gs[i]->fitness = gladiator_fitness(gs[i]);
-}
-
-static void mutate_gladiators(gladiator_t **gs, size_t count) {
-	for (size_t i = 0; i < count - 1; i++)
-		gs[i]->mutations = gladiator_mutate(gs[i]);
-}
-
 static void reinitialize_gladiator_starting_positions(gladiator_t **gs, size_t count) {
 	assert(gs);
 	if (arena_random_gladiator_start) {
@@ -612,83 +1171,166 @@ static void reinitialize_gladiators(gladiator_t **gs, size_t count) {
 		gs[i]->enemy_projectile_detected = 0;
 		gs[i]->food_detected = 0;
 		gs[i]->wall_contact_timer.i = 0;
+		gs[i]->stalemate = false;
 	}
 	reinitialize_gladiator_starting_positions(gs, count);
 }
 
-static void normalize_fitness(gladiator_t **gs, size_t count) {
-	double min = FLT_MAX;
-	for (size_t i = 0; i < count; i++)
-		min = MIN(min, gs[i]->fitness);
-	for (size_t i = 0; i < count; i++)
-		gs[i]->fitness = gs[i]->fitness - min;
+enum {
+	EVOLUTION_GENERATIONAL,
+	EVOLUTION_STEADY_STATE,
+	EVOLUTION_STRATEGY,
+};
+
+enum {
+	SELECTION_ROULETTE_WHEEL,
+	SELECTION_TOURNAMENT,
+};
+
+static size_t select_one(const double *fitness, size_t count, const alias_t *wheel) {
+	if (wheel)
+		return alias_sample(wheel);
+	return tournament_sample(fitness, count, selection_tournament_size);
 }
 
-static double total_fitness(gladiator_t **gs, size_t count) {
-	double total = 0;
-	normalize_fitness(gs, count);
-	for (size_t i = 0; i < count; i++)
-		total += gs[i]->fitness;
-	return total;
+/* Adds a gladiator to the lineage archive, parents not yet in it, which are
+ * from the first generation or were loaded, are added first. The genome of
+ * a child is stored as its differences from its first parent. */
+static void lineage_record(world_t *w, gladiator_t *g, gladiator_t *a, gladiator_t *b) {
+	assert(w && g);
+	if (!lineage_archive_on)
+		return;
+	const size_t length = brain_genome_length(g->brain);
+	if (!w->lineage && !(w->lineage = lineage_open(LINEAGE_FILE, LINEAGE_INDEX, length, true))) {
+		warning("turning the lineage archive off");
+		lineage_archive_on = false;
+		return;
+	}
+	if (a && !a->id)
+		lineage_record(w, a, NULL, NULL);
+	if (b && !b->id)
+		lineage_record(w, b, NULL, NULL);
+	double genome[length], base[length];
+	const double *from = NULL;
+	brain_genome_export(g->brain, genome);
+	if (a && a->id) {
+		from = genome; /* an unmutated copy */
+		if (a->hash != g->hash) {
+			brain_genome_export(a->brain, base);
+			from = base;
+		}
+	}
+	const unsigned generation = (a || b) ? w->generation : w->generation - !!w->generation;
+	g->id = lineage_add(w->lineage, generation, genome, a ? a->id : 0, b ? b->id : 0, from);
 }
 
-static void assign_teams(gladiator_t **gs, size_t count) {
-	for (size_t i = 0; i < count; i++)
-		gs[i]->team = i;
+/* A loaded world carries on with the lineage archive its gladiators were
+ * recorded in, if it is still there and holds all of them, otherwise their
+ * ids are cleared and they are recorded afresh in a new archive. */
+static void lineage_resume(world_t *w) {
+	assert(w);
+	uint64_t last = 0;
+	for (size_t i = 0; i < w->population_count; i++)
+		last = MAX(last, w->population[i]->id);
+	if (!last)
+		return;
+	if (lineage_archive_on) {
+		const size_t length = brain_genome_length(w->population[0]->brain);
+		if ((w->lineage = lineage_append(LINEAGE_FILE, LINEAGE_INDEX, length)) && lineage_count(w->lineage) >= last)
+			return;
+		warning("lineage archive '%s' does not hold the loaded gladiators, starting a new one", LINEAGE_FILE);
+		(void)lineage_close(w->lineage);
+		w->lineage = NULL;
+	}
+	for (size_t i = 0; i < w->population_count; i++)
+		w->population[i]->id = 0;
 }
 
-static void sort_gladiators(gladiator_t **gs, size_t count) {
-	qsort(gs, count, sizeof(gs[0]), fitness_compare_function);
-	assign_teams(gs, count);
+/* The parents of a child, only 'a' is used if the child is a copy */
+typedef struct {
+	size_t a, b;
+	bool breed;
+} parents_t;
+
+typedef struct {
+	gladiator_t **parents;
+	gladiator_t **children;
+	const parents_t *plan;
+	size_t count;
+	uint64_t seed;
+} breeding_t;
+
+/* Each child has its own random stream derived from the generation seed
+ * and its index, so the next generation is the same no matter how many
+ * threads build it or in which order. All children but the last are
+ * mutated. */
+static void breed_child(void *param, size_t i) {
+	breeding_t *b = param;
+	assert(b && i < b->count);
+	random_seed_u64(b->seed + i);
+	const parents_t *p = &b->plan[i];
+	gladiator_t *child = !p->breed ?
+		gladiator_copy(b->parents[p->a]) :
+		gladiator_breed(b->parents[p->a], b->parents[p->b]);
+	if (i < b->count - 1)
+		child->mutations = gladiator_mutate(child);
+	b->children[i] = child;
 }
 
-static void shuffle_gladiators(gladiator_t **gs, size_t count) {
+/* For the roulette wheel the fitness is shifted so that the least fit
+ * gladiator has no chance of being picked, the wheel is an alias table so
+ * each spin is O(1) instead of a linear scan. Parents are chosen here, in
+ * order, and the children are then built and mutated in parallel into the
+ * offspring buffer which becomes the new population. The population must
+ * have been ranked. */
+static void selection(world_t *w) {
+	assert(w);
+	gladiator_t **gs = w->population;
+	const size_t count = w->population_count;
+	const double *fitness = w->fitness;
+	alias_t *wheel = NULL;
+	if (selection_method == SELECTION_ROULETTE_WHEEL) {
+		double *weights = allocate(sizeof(weights[0]) * count);
+		for (size_t i = 0; i < count; i++)
+			weights[i] = fitness[i] - w->statistics.min;
+		wheel = alias_new(weights, count);
+		free(weights);
+	}
+	parents_t *plan = allocate(sizeof(plan[0]) * count);
 	for (size_t i = 0; i < count; i++) {
-		size_t a = random_u64() % count, b = random_u64() % count;
-		gladiator_t *t = gs[a];
-		gs[a] = gs[b];
-		gs[b] = t;
+		plan[i].a = plan[i].b = select_one(fitness, count, wheel);
+		double breed = random_float();
+		plan[i].breed = breed > breeding_rate && breeding_on;
+		if (plan[i].breed)
+			plan[i].b = select_one(fitness, count, wheel);
 	}
-}
-
-static size_t spin_wheel(double wheel[], size_t count) {
-	double r = random_float();
-	size_t i = 0;
-	for (i = 0; i < count; i++)
-		if (wheel[i] >= r)
-			break;
-	assert(i < count);
-	return i;
-}
-
-static gladiator_t **roulette_wheel_selection(gladiator_t **gs, size_t count) {
-	assert(gs);
-	update_fitness(gs, count);
-	sort_gladiators(gs, count);
-	double total = total_fitness(gs, count);
-	double selection[count ? count : 1];
-	gladiator_t **new = allocate(sizeof(new[0]) * count);
-	memset(selection, 0, sizeof(selection));
+	for (size_t i = count - 1; i > 0; i--) { /* shuffle, so the unmutated child is a random one */
+		const size_t j = random_u64() % (i + 1);
+		const parents_t t = plan[i];
+		plan[i] = plan[j];
+		plan[j] = t;
+	}
+	breeding_t b = { .parents = gs, .children = w->offspring, .plan = plan, .count = count, .seed = random_u64() };
+	const prng_t saved = random_state(); /* this thread may build children */
+	parallel_for(program_breeding_threads, count, breed_child, &b);
+	random_state_set(&saved);
 	for (size_t i = 0; i < count; i++)
-		selection[i] = gs[i]->fitness / total;
-	for (size_t i = 1; i < count; i++)
-		selection[i] += selection[i-1];
+		lineage_record(w, w->offspring[i], gs[plan[i].a], plan[i].breed ? gs[plan[i].b] : NULL);
 	for (size_t i = 0; i < count; i++) {
-		double breed = random_float();
-		if (breed > breeding_rate && breeding_on)
-			new[i] = gladiator_breed(gs[spin_wheel(selection, count)], gs[spin_wheel(selection, count)]);
-		else
-			new[i] = gladiator_copy(gs[spin_wheel(selection, count)]);
+		gladiator_delete(gs[i]);
+		gs[i] = NULL;
 	}
-	shuffle_gladiators(new, count);
-	return new;
+	w->population = w->offspring;
+	w->offspring  = gs;
+	alias_delete(wheel);
+	free(plan);
 }
 
+/* Food eaten in the last match comes back, so a match does not depend on
+ * what happened in the one before it */
 static void reinitialize_foods(food_t **fs, size_t count) {
-	for (size_t i = 0; i < count; i++) { /*randomize food positions*/
-		fs[i]->x = random_x();
-		fs[i]->y = random_y();
-	}
+	for (size_t i = 0; i < count; i++) /*randomize food positions*/
+		food_reactivate(fs[i], random_x(), random_y(), random_angle());
 }
 
 static void reinitialize_player(player_t *p) {
@@ -706,42 +1348,137 @@ static void gladiators_delete(gladiator_t **gs, size_t count) {
 	free(gs);
 }
 
-static void new_generation(world_t *w, FILE *out) {
+/* Points the current match at its members in the population and gets the
+ * arena ready for it */
+static void match_setup(world_t *w) {
 	assert(w);
-	assert(out);
-	size_t all = w->gladiator_count * (1uLL << w->gladiator_rounds);
+	w->match_prng = random_state();
+	const size_t *members = NULL;
+	w->match_size = schedule_match(w->schedule, w->match, &members);
+	assert(w->match_size <= w->gladiator_count);
+	for (size_t i = 0; i < w->match_size; i++)
+		w->gs[i] = w->population[members[i]];
 	for (size_t i = 0; i < w->projectile_count; i++) /*disable all projectiles*/
 		projectile_deactivate(w->ps[i]);
-	w->alive = w->gladiator_count;
+	w->alive = w->match_size;
+	w->round = schedule_round(w->schedule);
+	reinitialize_gladiators(w->gs, w->match_size);
+	reinitialize_foods(w->fs, w->food_count);
+	reinitialize_player(w->player);
+	w->stalemate = false;
+	w->max_ticks = round_max_ticks(w->schedule);
+	stalemate_reset(w, 0);
+}
+
+/* The one pass over the population at the end of a generation, the fitness
+ * of each gladiator is worked out, if 'evaluate' is set, and stored by index
+ * along with everything else the end of a generation needs to know about
+ * it. Without 'evaluate' the stored fitness is used. */
+static void rank_population(world_t *w, bool evaluate) {
+	assert(w);
+	population_statistics_t *st = &w->statistics;
+	*st = (population_statistics_t){ .min = DBL_MAX, .max = -DBL_MAX };
+	unsigned champion = 0;
+	for (size_t i = 0; i < w->population_count; i++) {
+		gladiator_t *g = w->population[i];
+		const double f = evaluate ? (w->fitness[i] = g->fitness = gladiator_fitness(g)) : w->fitness[i];
+		st->min = MIN(st->min, f);
+		st->max = MAX(st->max, f);
+		st->mean += f;
+		if (!i || g->round > champion || (g->round == champion && f > w->fitness[st->champion])) {
+			st->champion = i;
+			champion = g->round;
+		}
+	}
+	st->mean /= w->population_count;
+}
 
-	if (w->match >= ((1u << w->round)-1)) { /* next round */
+/* The population holds the candidates of the evolution strategy, their
+ * fitness moves the center and new candidates replace them. Each one is a
+ * fresh gladiator around a copy of the brain it replaces. The first time
+ * through the center is the genome of the champion. */
+static void evolution_strategy(world_t *w) {
+	assert(w);
+	gladiator_t **gs = w->population;
+	const size_t all = w->population_count, length = brain_genome_length(gs[0]->brain);
+	double *genome  = allocate(sizeof(genome[0]) * length);
+	if (!w->es) {
+		brain_genome_export(gs[w->statistics.champion]->brain, genome);
+		w->es = es_new(genome, length, all / 2, evolution_strategy_sigma, evolution_strategy_learning_rate);
+	} else {
+		es_update(w->es, w->fitness);
+	}
+	es_sample(w->es, random_u64(), program_breeding_threads);
+	for (size_t i = 0; i < all; i++) {
+		es_candidate(w->es, i, genome);
+		brain_t *b = brain_copy(gs[i]->brain);
+		brain_genome_import(b, genome);
+		gladiator_t *g = gladiator_new_with_brain(i, 0, 0, 0, b);
+		g->color = gs[i]->color;
+		gladiator_delete(gs[i]);
+		gs[i] = g;
+		lineage_record(w, g, NULL, NULL);
+	}
+	free(genome);
+}
+
+/* One line per generation, with the same fields for every evolution method
+ * so they can be compared, the population must have been ranked */
+static void generation_report(world_t *w, FILE *out) {
+	assert(w && out);
+	static const char *methods[] = { "generational", "steady-state", "strategy" };
+	const double now = wall_time();
+	if (verbose(NOTE))
+		fprintf(out, "generation, %2u, method, %s, best, %.3f, mean, %.3f, seconds, %.3f\n",
+				w->generation, evolution_method < 3 ? methods[evolution_method] : "unknown",
+				w->statistics.max, w->statistics.mean, now - w->generation_start);
+	w->generation_start = now;
+}
+
+/* Works out the fitness of the members of the current match, once, and
+ * hands it to the tournament */
+static void match_score(world_t *w) {
+	assert(w);
+	double fitness[w->match_size];
+	for (size_t i = 0; i < w->match_size; i++)
+		fitness[i] = w->gs[i]->fitness = gladiator_fitness(w->gs[i]);
+	schedule_result(w->schedule, w->match, fitness);
+}
+
+/* Moves on to the next match, and to the next round and generation as
+ * needed, the current match must have been scored */
+static void match_next(world_t *w, FILE *out) {
+	assert(w);
+	assert(out);
+	schedule_t *s = w->schedule;
+	const size_t all = w->population_count;
+	bool generation = false;
+	if (++w->match >= schedule_matches(s)) { /* next round */
 		w->match = 0;
-		w->gs = w->population;
-		for (size_t i = 0; i < (1u << (w->round - 1)); i++)
-			w->gs[i]->round = w->gladiator_rounds - w->round;
-		w->round--;
-		sort_gladiators(w->population, 1 << w->round);
-		if (!(w->round)) { /* next generation */
+		if (!schedule_next_round(s)) { /* next generation */
+			for (size_t i = 0; i < all; i++)
+				w->population[i]->round = schedule_wins(s, i);
+			hall_of_fame_benchmark(w, out);
+			rank_population(w, true);
+			hall_of_fame_update(w);
+			generation_report(w, out);
 			w->generation++;
-			w->round = w->gladiator_rounds;
-			sort_gladiators(w->gs, all);
-			gladiator_t **new = roulette_wheel_selection(w->population, all);
-			gladiators_delete(w->population, all);
-			w->population = new;
-			w->gs = w->population;
-
-			mutate_gladiators(w->population, all);
-			reinitialize_gladiators(w->population, all);
+			if (evolution_method == EVOLUTION_STRATEGY)
+				evolution_strategy(w);
+			else
+				selection(w);
+			schedule_restart(s);
+			generation = true;
 		}
-		if (w->round)
-			shuffle_gladiators(w->population, 1 << (w->round - 1));
-	} else { /* next match */
-		w->match++;
-		w->gs += w->gladiator_count;
 	}
-	reinitialize_gladiators(w->population, all);
-	reinitialize_foods(w->fs, w->food_count);
-	reinitialize_player(w->player);
+	match_setup(w);
+	if (generation)
+		world_checkpoint(w);
+}
+
+static void new_generation(world_t *w, FILE *out) {
+	match_score(w);
+	match_next(w, out);
 }
 
 static gladiator_t **gladiators_new(size_t count) {
@@ -769,26 +1506,55 @@ static food_t **foods_new(size_t count) {
 	return fs;
 }
 
-static world_t *initialize_arena(size_t gladiator_count, size_t rounds, size_t projectile_count, size_t food_count) {
+static world_t *initialize_arena(size_t gladiator_count, size_t population, size_t projectile_count, size_t food_count) {
+	assert(gladiator_count >= 2 && population >= gladiator_count);
 	world_t *w = allocate(sizeof(*w));
-	w->alive            = gladiator_count;
 	w->gladiator_count  = gladiator_count;
+	w->population_count = population;
 	w->projectile_count = projectile_count;
 	w->food_count       = food_active ? food_count : 0;
-	w->round            = rounds;
-	w->gladiator_rounds = rounds;
-	w->population       = gladiators_new(gladiator_count*(1 << rounds));
-	w->gs               = w->population;
+	w->gladiator_rounds = arena_gladiator_rounds;
+	w->population       = gladiators_new(population);
+	w->offspring        = allocate(sizeof(w->offspring[0]) * population);
+	w->fitness          = allocate(sizeof(w->fitness[0]) * population);
+	w->gs               = allocate(sizeof(w->gs[0]) * gladiator_count);
+	w->schedule         = schedule_new(arena_tournament_method, population, gladiator_count, arena_gladiator_rounds);
 	w->match            = 0;
-	w->generation       = 0;;
+	w->generation       = 0;
+	w->generation_start = wall_time();
 	w->ps               = projectiles_new(projectile_count);
 	w->fs               = foods_new(food_count);
 	w->player           = player_new(UINT_MAX);
 	w->player->x        = Xmax / 2.0;
 	w->player->y        = Ymax / 2.0;
+	match_setup(w);
 	return w;
 }
 
+static void world_delete(world_t *w) {
+	if (!w)
+		return;
+	gladiators_delete(w->population, w->population_count);
+	free(w->offspring);
+	free(w->fitness);
+	cache_delete(w->cache);
+	hall_delete(w->hall);
+	es_delete(w->es);
+	if (lineage_close(w->lineage) < 0)
+		warning("failed to close lineage archive");
+	world_delete(w->hall_arena);
+	free(w->gs);
+	schedule_delete(w->schedule);
+	for (size_t i = 0; i < w->projectile_count; i++)
+		projectile_delete(w->ps[i]);
+	free(w->ps);
+	for (size_t i = 0; i < w->food_count; i++)
+		food_delete(w->fs[i]);
+	free(w->fs);
+	player_delete(w->player);
+	free(w);
+}
+
 static int timer_cb(void *param, int value) {
 	assert(param);
 	UNUSED(value);
@@ -855,12 +1621,17 @@ static int resize_cb(void *param, int w, int h, resize_t *rsz) {
 	return 0;
 }
 
+static bool match_is_over(world_t *w) {
+	assert(w);
+	return w->tick > w->max_ticks || w->alive <= 1 || w->stalemate;
+}
+
 static int draw_cb(void *draw_param) {
 	assert(draw_param);
 
 	world_t *w = draw_param;
 
-	for (size_t i = 0; i < w->gladiator_count; i++)
+	for (size_t i = 0; i < w->match_size; i++)
 		gladiator_draw(w->gs[i]);
 
 	for (size_t i = 0; i < w->projectile_count; i++)
@@ -875,7 +1646,7 @@ static int draw_cb(void *draw_param) {
 	player_draw(w->player);
 
 	if (w->next != w->tick && (!arena_paused || w->step)) {
-		if (w->tick > max_ticks_per_generation || w->alive <= 1 || w->skip) {
+		if (match_is_over(w) || w->skip) {
 			new_generation(w, stderr);
 			w->tick = 0;
 			arena_paused = program_pause_after_new_generation;
@@ -924,30 +1695,611 @@ static int print_fitness(FILE *out, gladiator_t **gs, size_t count) {
 	return 0;
 }
 
-static void headless_loop(world_t *w, FILE *out, unsigned count, bool forever) {
-	for (w->tick = 0; w->generation < count || forever; w->tick++) {
-		if (w->tick > max_ticks_per_generation || w->alive <= 1) {
-			update_fitness(w->gs, w->gladiator_count);
-			if (verbose(NOTE)) {
-				unsigned round = 1 + w->gladiator_rounds - w->round;
-				fprintf(out, "generation, %2u, round, %2u, match, %2u, ", w->generation, round, w->match);
-			}
+static void match_end(world_t *w, FILE *out) {
+	assert(w);
+	assert(out);
+	match_score(w);
+	bool stalemate = false;
+	for (size_t i = 0; i < w->match_size; i++)
+		stalemate |= w->gs[i]->stalemate;
+	if (verbose(NOTE)) {
+		fprintf(out, "generation, %2u, round, %2u, match, %2u, ", w->generation, w->round + 1, w->match);
+		fprintf(out, "tick, %5u, stalemate, %u, fitness, ", w->tick, (unsigned)stalemate);
+		print_fitness(out, w->gs, w->match_size);
+		fputc('\n', out);
+	}
+	match_next(w, out);
+	w->tick = 0;
+}
 
-			//gladiator_t **gs = w->gs;
-			new_generation(w, out);
+/* Plays a single match in the arena 'w' between gladiators with the given
+ * genomes and starting states, the final states are written back and the
+ * number of ticks the match took is returned. */
+static uint64_t arena_match(world_t *w, const double *const *genomes, double *const *states, size_t count, uint64_t seed, uint64_t limit) {
+	assert(w && genomes && states);
+	assert(count <= w->gladiator_count);
+	random_seed_u64(seed);
+	for (size_t i = 0; i < count; i++) {
+		gladiator_t *g = w->gs[i];
+		brain_genome_import(g->brain, genomes[i]);
+		gladiator_state_import(g, states[i]);
+		g->team = i;
+	}
+	for (size_t i = 0; i < w->projectile_count; i++)
+		projectile_deactivate(w->ps[i]);
+	reinitialize_foods(w->fs, w->food_count);
+	w->match_size = count;
+	w->alive = count;
+	w->max_ticks = limit;
+	w->stalemate = false;
+	stalemate_reset(w, 0);
+	for (w->tick = 0; !match_is_over(w); w->tick++)
+		update_scene(w);
+	for (size_t i = 0; i < count; i++)
+		gladiator_state_export(w->gs[i], states[i]);
+	return w->tick;
+}
 
-			if (verbose(NOTE)) { /* BUG: Fitness is incorrect, we've just shuffled everything */
-				fprintf(out, "tick, %5u, fitness, ", w->tick);
-				print_fitness(out, w->gs /*gs*/, w->gladiator_count);
-				fputc('\n', out);
-			}
+/* Runs within a worker process; each worker has its own world for running
+ * matches in, which is created after the fork so that creating it does not
+ * disturb the PRNG of the coordinating process. The gladiators genomes and
+ * their starting state come from the shared pool and their state at the end
+ * of the match is written back into it. */
+static int worker_match(void *param, worker_pool_t *p, size_t match) {
+	assert(param);
+	assert(p);
+	static world_t *w = NULL;
+	world_t *coordinator = param;
+	if (!w) {
+		world_save_at_exit = false; /* only the coordinator may save the world */
+		w = initialize_arena(coordinator->gladiator_count, coordinator->gladiator_count, coordinator->projectile_count, coordinator->food_count);
+	}
+	const size_t *members = NULL;
+	const size_t count = worker_match_members(p, match, &members);
+	assert(count <= coordinator->gladiator_count);
+	const double *genomes[count];
+	double *states[count];
+	for (size_t i = 0; i < count; i++) {
+		genomes[i] = worker_genome(p, members[i]);
+		states[i]  = worker_state(p, match, i);
+	}
+	worker_match_result_set(p, match, arena_match(w, genomes, states, count, worker_match_seed(p, match), worker_match_limit(p, match)));
+	return 0;
+}
 
-			w->tick = 0;
+static worker_pool_t *workers_new(world_t *w, unsigned workers) {
+	assert(w);
+	if (!workers)
+		return NULL;
+	const size_t genome_length = brain_genome_length(w->population[0]->brain);
+	const size_t all = w->population_count, opponents = hall_of_fame_size ? hall_of_fame_opponents : 0;
+	worker_pool_t *p = worker_pool_new(workers, all + opponents, genome_length, GLADIATOR_STATE_LAST,
+			MAX(schedule_max_matches(w->schedule), all * opponents), w->gladiator_count, worker_match, w);
+	if (!p)
+		warning("failed to start %u worker processes, running matches in process", workers);
+	return p;
+}
+
+/* A match run by a worker is a function of the genomes of its members,
+ * their starting state, the tick limit and its seed. When results are
+ * cached the seed and the starting positions are derived from the genomes
+ * and the evaluation seed, instead of the PRNG, so that a repeated match
+ * has the same key and its result can be reused. Returns the key. */
+static uint64_t match_prepare(world_t *w, worker_pool_t *p, size_t slot, gladiator_t **gs, const size_t *members, size_t count) {
+	assert(w && p && gs && members);
+	uint64_t key = hash64(&w->max_ticks, sizeof(w->max_ticks), w->evaluation_seed);
+	if (w->cache) {
+		for (size_t i = 0; i < count; i++)
+			key = hash64(&gs[i]->hash, sizeof(gs[i]->hash), key);
+		const prng_t saved = random_state();
+		random_seed_u64(key);
+		reinitialize_gladiators(gs, count);
+		random_state_set(&saved);
+	} else {
+		reinitialize_gladiators(gs, count);
+	}
+	for (size_t i = 0; i < count; i++)
+		gladiator_state_export(gs[i], worker_state(p, slot, i));
+	if (w->cache)
+		key = hash64(worker_state(p, slot, 0), sizeof(double) * GLADIATOR_STATE_LAST * count, key);
+	worker_match_set(p, slot, members, count, w->cache ? key : random_u64(), w->max_ticks);
+	return key;
+}
+
+/* Cached results hold the tick count followed by the end state of each
+ * member */
+static void match_cache(world_t *w, worker_pool_t *p, size_t slot, uint64_t key) {
+	assert(w && w->cache && p);
+	double value[1 + (GLADIATOR_STATE_LAST * w->gladiator_count)];
+	const size_t *members = NULL;
+	const size_t count = worker_match_members(p, slot, &members);
+	memset(value, 0, sizeof(value));
+	value[0] = worker_match_result(p, slot);
+	for (size_t i = 0; i < count; i++)
+		memcpy(&value[1 + (i * GLADIATOR_STATE_LAST)], worker_state(p, slot, i), sizeof(double) * GLADIATOR_STATE_LAST);
+	cache_insert(w->cache, key, value);
+}
+
+static void print_cache_statistics(world_t *w, FILE *out) {
+	assert(w && out);
+	if (!w->cache)
+		return;
+	size_t lookups = 0, hits = 0;
+	cache_statistics(w->cache, &lookups, &hits);
+	cache_statistics_reset(w->cache);
+	if (verbose(NOTE))
+		fprintf(out, "generation, %2u, cache lookups, %zu, hits, %zu, hit rate, %.3f\n",
+				w->generation - 1, lookups, hits, lookups ? (double)hits / lookups : 0.0);
+}
+
+/* All of the remaining matches in a round are independent of each other, so
+ * they are handed to the worker pool as one batch, the results are then fed
+ * back through the normal tournament logic one match at a time. Matches
+ * found in the cache are not posted to the pool, their results are copied
+ * into the slots after the posted ones instead. New results are cached
+ * before any are used as the end of a generation can reuse the pool to
+ * play the hall of fame. */
+static int workers_run_round(world_t *w, worker_pool_t *p, FILE *out) {
+	assert(w && p && out);
+	if (evaluation_cache_entries && !w->cache) {
+		w->cache = cache_new(evaluation_cache_entries, 1 + (GLADIATOR_STATE_LAST * w->gladiator_count));
+		w->evaluation_seed = random_u64();
+	}
+	const size_t first = w->match, matches = schedule_matches(w->schedule) - first;
+	uint64_t keys[matches];
+	bool cached[matches];
+	size_t slots[matches], posted = 0, hits = 0;
+	for (size_t m = 0; m < matches; m++) {
+		const size_t *members = NULL;
+		const size_t count = schedule_match(w->schedule, first + m, &members);
+		gladiator_t *gs[count];
+		for (size_t i = 0; i < count; i++) {
+			gs[i] = w->population[members[i]];
+			brain_genome_export(gs[i]->brain, worker_genome(p, members[i]));
 		}
+		keys[m] = match_prepare(w, p, posted, gs, members, count);
+		const double *hit = w->cache ? cache_lookup(w->cache, keys[m]) : NULL;
+		cached[m] = hit != NULL;
+		if (!hit) {
+			slots[m] = posted++;
+			continue;
+		}
+		slots[m] = matches - ++hits;
+		for (size_t i = 0; i < count; i++)
+			memcpy(worker_state(p, slots[m], i), &hit[1 + (i * GLADIATOR_STATE_LAST)], sizeof(double) * GLADIATOR_STATE_LAST);
+		worker_match_result_set(p, slots[m], hit[0]);
+	}
+	if (worker_pool_run(p, posted) < 0)
+		return -1;
+	for (size_t m = 0; w->cache && m < matches; m++)
+		if (!cached[m])
+			match_cache(w, p, slots[m], keys[m]);
+	const unsigned generation = w->generation;
+	for (size_t m = 0; m < matches; m++) {
+		assert(w->match == first + m);
+		for (size_t i = 0; i < w->match_size; i++)
+			gladiator_state_import(w->gs[i], worker_state(p, slots[m], i));
+		w->tick = worker_match_result(p, slots[m]);
+		match_end(w, out);
+	}
+	if (w->generation != generation)
+		print_cache_statistics(w, out);
+	return 0;
+}
+
+/* Each gladiator plays the same sample of champions, and the match against
+ * a champion always has the same seed and starting positions, so scores
+ * can be compared across the population. Only the first member of each
+ * match is being evaluated, the rest are champions. The matches are run by
+ * the workers running the tournament if there are any, otherwise they are
+ * run in process in an arena kept for the purpose. */
+static int hall_evaluate(world_t *w, const size_t *opponents, size_t k, FILE *out) {
+	assert(w && opponents && k && out);
+	const size_t all = w->population_count, count = w->gladiator_count, matches = all * k;
+	const size_t length = brain_genome_length(w->population[0]->brain);
+	worker_pool_t *p = w->pool;
+	if (p && (worker_pool_genomes(p) < all + k || worker_pool_matches(p) < matches))
+		p = NULL;
+	const prng_t saved = random_state();
+	if (!p && !w->hall_arena)
+		w->hall_arena = initialize_arena(count, count, w->projectile_count, w->food_count);
+	for (size_t i = 0; p && i < all; i++)
+		brain_genome_export(w->population[i]->brain, worker_genome(p, i));
+	for (size_t j = 0; p && j < k; j++)
+		memcpy(worker_genome(p, all + j), hall_genome(w->hall, opponents[j]), sizeof(double) * length);
+	double *scores = allocate(sizeof(scores[0]) * all);
+	double genome[length], state[count][GLADIATOR_STATE_LAST];
+	gladiator_t scratch[count], *gs[count];
+	for (size_t m = 0; m < matches; m++) {
+		const size_t genome_index = m / k, opponent = m % k;
+		const uint64_t hash = hall_hash(w->hall, opponents[opponent]);
+		const uint64_t seed = hash64(&hash, sizeof(hash), w->hall_seed);
+		size_t members[count];
+		members[0] = genome_index;
+		for (size_t i = 1; i < count; i++)
+			members[i] = all + ((opponent + i - 1) % k);
+		memset(scratch, 0, sizeof(scratch));
+		for (size_t i = 0; i < count; i++)
+			gs[i] = &scratch[i];
+		random_seed_u64(seed);
+		reinitialize_gladiators(gs, count);
+		if (p) {
+			for (size_t i = 0; i < count; i++)
+				gladiator_state_export(gs[i], worker_state(p, m, i));
+			worker_match_set(p, m, members, count, seed, max_ticks_per_generation);
+			continue;
+		}
+		if (!opponent)
+			brain_genome_export(w->population[genome_index]->brain, genome);
+		const double *genomes[count];
+		double *states[count];
+		genomes[0] = genome;
+		for (size_t i = 1; i < count; i++)
+			genomes[i] = hall_genome(w->hall, opponents[members[i] - all]);
+		for (size_t i = 0; i < count; i++) {
+			states[i] = state[i];
+			gladiator_state_export(gs[i], states[i]);
+		}
+		(void)arena_match(w->hall_arena, genomes, states, count, seed, max_ticks_per_generation);
+		gladiator_t g = { .fitness = 0 };
+		gladiator_state_import(&g, states[0]);
+		scores[genome_index] += gladiator_fitness(&g);
+	}
+	random_state_set(&saved);
+	if (p && worker_pool_run(p, matches) < 0) {
+		free(scores);
+		return -1;
+	}
+	for (size_t m = 0; p && m < matches; m++) {
+		gladiator_t g = { .fitness = 0 };
+		gladiator_state_import(&g, worker_state(p, m, 0));
+		scores[m / k] += gladiator_fitness(&g);
+	}
+	double mean = 0, best = -DBL_MAX;
+	for (size_t i = 0; i < all; i++) {
+		const double score = scores[i];
+		w->population[i]->benchmark = score / k;
+		mean += score / k;
+		best = MAX(best, score / k);
+	}
+	if (verbose(NOTE))
+		fprintf(out, "generation, %2u, hall of fame, %zu, opponents, %zu, benchmark mean, %.3f, best, %.3f\n",
+				w->generation, hall_count(w->hall), k, mean / all, best);
+	free(scores);
+	return 0;
+}
+
+/* Benchmarks the population against the hall of fame, this is done before
+ * the population is ranked as the benchmark is part of their fitness */
+static void hall_of_fame_benchmark(world_t *w, FILE *out) {
+	assert(w && out);
+	if (!hall_of_fame_size || !program_run_headless)
+		return;
+	if (!w->hall) {
+		w->hall = hall_new(hall_of_fame_size, brain_genome_length(w->population[0]->brain));
+		w->hall_seed = random_u64();
+	}
+	size_t opponents[hall_of_fame_opponents];
+	const size_t k = hall_sample(w->hall, opponents, hall_of_fame_opponents);
+	if (k && hall_evaluate(w, opponents, k, out) < 0) {
+		warning("hall of fame evaluation failed, turning the hall of fame off");
+		hall_of_fame_size = 0;
+	}
+}
+
+/* Enters the champion of a ranked population into the hall of fame */
+static void hall_of_fame_update(world_t *w) {
+	assert(w);
+	if (!w->hall || !hall_of_fame_size)
+		return;
+	gladiator_t *best = w->population[w->statistics.champion];
+	double genome[brain_genome_length(best->brain)];
+	brain_genome_export(best->brain, genome);
+	hall_add(w->hall, best->hash, genome);
+}
+
+typedef struct {
+	world_t *w;
+	FILE *out;
+	size_t *idle; /* gladiators not currently in a match */
+	size_t idle_count;
+	size_t running, matches, births;
+	unsigned generations;
+	bool forever;
+} steady_state_t;
+
+static int steady_state_schedule(steady_state_t *s, worker_pool_t *p, size_t match) {
+	assert(s && p);
+	world_t *w = s->w;
+	const size_t count = w->gladiator_count;
+	assert(s->idle_count >= count);
+	size_t members[count];
+	gladiator_t *gs[count];
+	for (size_t i = 0; i < count; i++) {
+		const size_t j = random_u64() % s->idle_count;
+		members[i] = s->idle[j];
+		s->idle[j] = s->idle[--s->idle_count];
+		gs[i] = w->population[members[i]];
+		brain_genome_export(gs[i]->brain, worker_genome(p, members[i]));
+	}
+	reinitialize_gladiators(gs, count);
+	for (size_t i = 0; i < count; i++)
+		gladiator_state_export(gs[i], worker_state(p, match, i));
+	worker_match_set(p, match, members, count, random_u64(), max_ticks_per_generation);
+	s->running++;
+	return worker_match_post(p, match);
+}
+
+/* The bottom half of a finished match are replaced straight away with the
+ * offspring of parents drawn by tournament from the whole population, and
+ * the slot is used for a new match, every 'all' births counts as a
+ * generation. */
+static int steady_state_match_done(void *param, worker_pool_t *p, size_t match) {
+	assert(param && p);
+	steady_state_t *s = param;
+	world_t *w = s->w;
+	const size_t all = w->population_count;
+	const size_t *members = NULL;
+	const size_t count = worker_match_members(p, match, &members);
+	rank_t order[count];
+	gladiator_t *gs[count];
+	bool stalemate = false;
+	for (size_t i = 0; i < count; i++) {
+		gladiator_t *g = w->population[members[i]];
+		gladiator_state_import(g, worker_state(p, match, i));
+		g->round = 0;
+		order[i].key = w->fitness[members[i]] = g->fitness = gladiator_fitness(g);
+		order[i].index = members[i];
+		stalemate |= g->stalemate;
+		gs[i] = g;
+	}
+	rank_top(order, count, count);
+	if (verbose(NOTE)) {
+		fprintf(s->out, "generation, %2u, round, %2u, match, %2zu, tick, %5u, stalemate, %u, fitness, ",
+				w->generation, 0u, s->matches, (unsigned)worker_match_result(p, match), (unsigned)stalemate);
+		print_fitness(s->out, gs, count);
+		fputc('\n', s->out);
+	}
+	for (size_t i = count - (count / 2); i < count; i++) {
+		gladiator_t *a = w->population[tournament_sample(w->fitness, all, selection_tournament_size)];
+		gladiator_t *b = w->population[tournament_sample(w->fitness, all, selection_tournament_size)];
+		gladiator_t *child = NULL;
+		const bool breed = random_float() > breeding_rate && breeding_on;
+		if (breed)
+			child = gladiator_breed(a, b);
+		else
+			child = gladiator_copy(a);
+		child->mutations = gladiator_mutate(child);
+		lineage_record(w, child, a, breed ? b : NULL);
+		gladiator_delete(w->population[order[i].index]);
+		w->population[order[i].index] = child;
+		w->fitness[order[i].index] = child->fitness;
+		if (++s->births >= all) {
+			s->births = 0;
+			rank_population(w, false);
+			generation_report(w, s->out);
+			w->generation++;
+			world_checkpoint(w);
+		}
+	}
+	for (size_t i = 0; i < count; i++)
+		s->idle[s->idle_count++] = order[i].index;
+	s->running--;
+	s->matches++;
+	if (w->generation < s->generations || s->forever)
+		return steady_state_schedule(s, p, match);
+	return 0;
+}
+
+/* There is no generation barrier in this mode, each match slot is refilled
+ * as soon as its match is done so the workers are never left idle waiting
+ * on the slowest match in a round. */
+static int steady_state_loop(world_t *w, worker_pool_t *p, FILE *out, unsigned count, bool forever) {
+	assert(w && p && out);
+	const size_t all = w->population_count;
+	const size_t slots = MIN(2 * worker_pool_workers(p), all / w->gladiator_count);
+	steady_state_t s = {
+		.w = w, .out = out, .generations = count, .forever = forever,
+		.idle = allocate(sizeof(s.idle[0]) * all), .idle_count = all,
+	};
+	int r = 0;
+	for (size_t i = 0; i < all; i++) {
+		s.idle[i] = i;
+		w->fitness[i] = w->population[i]->fitness;
+	}
+	if (worker_pool_start(p) < 0) {
+		r = -1;
+		goto done;
+	}
+	for (size_t m = 0; m < slots && (w->generation < count || forever); m++)
+		if ((r = steady_state_schedule(&s, p, m)) < 0)
+			goto done;
+	while (s.running)
+		if ((r = worker_pool_poll(p, steady_state_match_done, &s)) < 0)
+			break;
+done:
+	worker_pool_stop(p);
+	free(s.idle);
+	schedule_restart(w->schedule);
+	w->match = 0;
+	w->tick = 0;
+	match_setup(w);
+	return r;
+}
+
+static void headless_loop(world_t *w, FILE *out, unsigned count, bool forever) {
+	const bool steady = evolution_method == EVOLUTION_STEADY_STATE;
+	worker_pool_t *p = workers_new(w, steady ? MAX(1u, program_worker_processes) : program_worker_processes);
+	if (p && steady && steady_state_loop(w, p, out, count, forever) < 0) {
+		warning("worker pool failed, running matches in process");
+		worker_pool_delete(p);
+		p = NULL;
+	}
+	w->pool = p; /* the hall of fame is played by the same workers */
+	while (p && (w->generation < count || forever)) {
+		if (workers_run_round(w, p, out) < 0) {
+			warning("worker pool failed, running matches in process");
+			worker_pool_delete(p);
+			w->pool = p = NULL;
+		}
+	}
+	w->pool = NULL;
+	worker_pool_delete(p);
+	for (w->tick = 0; w->generation < count || forever; w->tick++) {
+		if (match_is_over(w))
+			match_end(w, out);
 		update_scene(w);
 	}
 }
 
+typedef struct {
+	service_t *s;
+	const service_batch_t *b;
+	world_t *w;
+	size_t per_genome;
+	size_t *remaining;
+	double *sums, *fitness;
+} service_evaluation_t;
+
+static int service_match_done(void *param, worker_pool_t *p, size_t match) {
+	assert(param && p);
+	service_evaluation_t *e = param;
+	const size_t genome = match / e->per_genome;
+	const double *state = worker_state(p, match, 0);
+	double *sums = &e->sums[genome * GLADIATOR_STATE_LAST];
+	gladiator_t *g = e->w->gs[0];
+	gladiator_state_import(g, state);
+	g->round = 0;
+	g->fitness = 0;
+	e->fitness[genome] += gladiator_fitness(g);
+	for (size_t i = 0; i < GLADIATOR_STATE_LAST; i++)
+		sums[i] += state[i];
+	if (--e->remaining[genome])
+		return 0;
+	for (size_t i = 0; i < GLADIATOR_STATE_LAST; i++)
+		sums[i] /= e->per_genome;
+	return service_result(e->s, e->b, genome, e->per_genome, sums, e->fitness[genome] / e->per_genome);
+}
+
+/* The service keeps one worker pool, along with the arena its workers were
+ * forked with, for as long as it runs. The workers only see the configuration
+ * they were forked with, so the pool is made again when that changes, as it
+ * can for a single batch, or when a batch does not fit in it. */
+typedef struct {
+	worker_pool_t *p;
+	world_t *w;
+	uint64_t digest;
+	size_t workers, genomes, matches;
+} service_pool_t;
+
+static void service_pool_delete(service_pool_t *sp) {
+	assert(sp);
+	worker_pool_delete(sp->p);
+	world_delete(sp->w);
+	*sp = (service_pool_t) { .p = NULL };
+}
+
+static worker_pool_t *service_pool(service_pool_t *sp, const service_batch_t *b) {
+	assert(sp && b);
+	const size_t count = arena_gladiator_count, workers = MAX(1u, program_worker_processes);
+	size_t genomes = b->genomes + b->opponents, matches = b->genomes * b->opponents;
+	const uint64_t digest = config_digest();
+	if (sp->p && sp->digest == digest && sp->workers == workers) {
+		if (sp->genomes >= genomes && sp->matches >= matches)
+			return sp->p;
+		genomes = MAX(genomes, sp->genomes);
+		matches = MAX(matches, sp->matches);
+	}
+	service_pool_delete(sp);
+	sp->w = initialize_arena(count, count, arena_projectile_count, arena_food_count);
+	sp->p = worker_pool_new(workers, genomes, b->genome_length, GLADIATOR_STATE_LAST, matches, count, worker_match, sp->w);
+	if (!sp->p) {
+		service_pool_delete(sp);
+		return NULL;
+	}
+	sp->digest  = digest;
+	sp->workers = workers;
+	sp->genomes = genomes;
+	sp->matches = matches;
+	return sp->p;
+}
+
+/* Each genome plays one match against each opponent, with any remaining
+ * places in the arena filled by the opponents that follow it. Every match in
+ * the batch is posted to the worker pool at once. */
+static int service_evaluate(void *param, service_t *s, const service_batch_t *b) {
+	service_pool_t *sp = param;
+	assert(sp && s && b && b->genomes && b->opponents);
+	const size_t count = arena_gladiator_count, matches = b->genomes * b->opponents;
+	worker_pool_t *p = service_pool(sp, b);
+	world_t *w = sp->w;
+	service_evaluation_t e = {
+		.s = s, .b = b, .w = w, .per_genome = b->opponents,
+		.remaining = allocate(sizeof(e.remaining[0]) * b->genomes),
+		.sums      = allocate(sizeof(e.sums[0]) * b->genomes * GLADIATOR_STATE_LAST),
+		.fitness   = allocate(sizeof(e.fitness[0]) * b->genomes),
+	};
+	int r = -1;
+	if (!p)
+		goto fail;
+	for (size_t i = 0; i < b->genomes; i++)
+		memcpy(worker_genome(p, i), &b->genome[i * b->genome_length], sizeof(double) * b->genome_length);
+	for (size_t i = 0; i < b->opponents; i++)
+		memcpy(worker_genome(p, b->genomes + i), &b->opponent[i * b->genome_length], sizeof(double) * b->genome_length);
+	for (size_t m = 0; m < matches; m++) {
+		const size_t genome = m / b->opponents, opponent = m % b->opponents;
+		size_t members[count];
+		members[0] = genome;
+		for (size_t i = 1; i < count; i++)
+			members[i] = b->genomes + ((opponent + i - 1) % b->opponents);
+		reinitialize_gladiators(w->gs, count);
+		for (size_t i = 0; i < count; i++)
+			gladiator_state_export(w->gs[i], worker_state(p, m, i));
+		worker_match_set(p, m, members, count, random_u64(), max_ticks_per_generation);
+	}
+	for (size_t i = 0; i < b->genomes; i++)
+		e.remaining[i] = b->opponents;
+	if (worker_pool_post(p, matches) < 0)
+		goto fail;
+	r = worker_pool_wait(p, matches, service_match_done, &e);
+fail:
+	if (r < 0) /* the pool may be left part way through a batch */
+		service_pool_delete(sp);
+	free(e.remaining);
+	free(e.sums);
+	free(e.fitness);
+	return r;
+}
+
+/* The genome is printed in the form the evaluation service accepts */
+static int lineage_print(FILE *out, uint64_t id) {
+	assert(out);
+	lineage_t *l = lineage_open(LINEAGE_FILE, LINEAGE_INDEX, 0, false);
+	if (!l)
+		return -1;
+	const size_t length = lineage_genome_length(l);
+	double *genome = allocate(sizeof(genome[0]) * length);
+	uint64_t a = 0, b = 0;
+	unsigned generation = 0;
+	int r = -1;
+	if (lineage_parents(l, id, &a, &b, &generation) < 0 || lineage_genome(l, id, genome) < 0) {
+		warning("genome %llu is not in the lineage archive (of %llu)", (unsigned long long)id, (unsigned long long)lineage_count(l));
+		goto done;
+	}
+	note("genome %llu, generation %u, parents %llu %llu", (unsigned long long)id, generation, (unsigned long long)a, (unsigned long long)b);
+	if (fputs("(genome", out) < 0)
+		goto done;
+	for (size_t i = 0; i < length; i++)
+		if (fprintf(out, " %.17g", genome[i]) < 0)
+			goto done;
+	r = fputs(")\n", out) < 0 ? -1 : 0;
+done:
+	free(genome);
+	if (lineage_close(l) < 0)
+		r = -1;
+	return r;
+}
+
 static int help(FILE *out, const char *arg0) {
 	assert(out);
 	assert(arg0);
@@ -967,6 +2319,10 @@ that can fire at and evade each other.\n\
 \t-p  print out the default configuration to stdout and exit\n\
 \t-h  print this help message and exit\n\
 \t-H  run without the GUI, or run in 'headless' mode\n\
+\t-D  run a genome evaluation service on the socket 'gladiator.sock'\n\
+\t-b  run the micro benchmarks and exit\n\
+\t-l  print genome <id> from the lineage archive 'gladiator.lin' and exit\n\
+\t-c  convert world <from> to <to> and exit, '.lsp' files are S-Expressions\n\
 \n\
 When running in GUI mode there are a few commands that can issued:\n\
 \n\
@@ -984,8 +2340,17 @@ In headless mode any human players (if enabled) are not present.\n\
 	return 0;
 }
 
+static size_t population_size(void) {
+	const size_t population = arena_population ? arena_population : arena_gladiator_count * (1uLL << arena_gladiator_rounds);
+	if (population < arena_gladiator_count)
+		error("population of %zu is smaller than the number of gladiators in a match (%u)", population, arena_gladiator_count);
+	return population;
+}
+
 /* TODO: Make it so this is specified via the command line only. */
 static void save(void) {
+	if (snapshot_wait() < 0)
+		warning("the last checkpoint could not be written");
 	if (world_save_at_exit)
 		world_save(world, WORLD_FILE);
 }
@@ -994,7 +2359,8 @@ static void save(void) {
 int main(int argc, char **argv) {
 	bool log_level_set = false;
 	int log_level = program_log_level;
-	bool run_headless = false;
+	bool run_headless = false, run_service = false, run_benchmark = false;
+	const char *convert_from = NULL, *convert_to = NULL;
 	int i = 0;
 	if (atexit(save) < 0)
 		error("failed to register with atexit");
@@ -1015,6 +2381,22 @@ int main(int argc, char **argv) {
 		case 'H':
 			run_headless = true;
 			break;
+		case 'D':
+			run_service = true;
+			break;
+		case 'b':
+			run_benchmark = true;
+			break;
+		case 'l':
+			if (i + 1 >= argc)
+				error("-l expects a genome id");
+			return lineage_print(stdout, strtoull(argv[++i], NULL, 0)) < 0 ? 1 : 0;
+		case 'c':
+			if (i + 2 >= argc)
+				error("-c expects a file to convert from and one to convert to");
+			convert_from = argv[++i];
+			convert_to   = argv[++i];
+			break;
 		case 'h':
 			help(stdout, argv[0]);
 			return 0;
@@ -1032,15 +2414,30 @@ done:
 	if (log_level_set)
 		program_log_level = log_level;
 
+	if (run_benchmark)
+		return benchmark(stdout) < 0 ? 1 : 0;
+	if (run_service) {
+		service_pool_t sp = { .p = NULL };
+		const int r = service_run(SERVICE_SOCKET, service_evaluate, &sp);
+		service_pool_delete(&sp);
+		return r < 0 ? 1 : 0;
+	}
+	if (convert_from)
+		return world_convert(convert_from, convert_to) < 0 ? 1 : 0;
+
 	if (world_load_at_start) {
-		world = world_load(WORLD_FILE);
-		if (world)
-			note("loaded world from %s", WORLD_FILE);
+		const char *file = WORLD_FILE;
+		if (!(world = world_load(file)))
+			world = world_load(file = WORLD_EXPORT_FILE);
+		if (world) {
+			note("loaded world from %s", file);
+			lineage_resume(world);
+		}
 		else
-			warning("failed to load world from %s", WORLD_FILE);
+			warning("failed to load world from %s or %s", WORLD_FILE, WORLD_EXPORT_FILE);
 	}
 	if (!world)
-		world = initialize_arena(arena_gladiator_count, arena_gladiator_rounds, arena_projectile_count, arena_food_count);
+		world = initialize_arena(arena_gladiator_count, population_size(), arena_projectile_count, arena_food_count);
 	if (!world)
 		error("World initialization failed");
 
@@ -0,0 +1,89 @@
+/** @file       parallel.c
+ *  @brief      Run independent loop iterations on a set of threads
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com
+ *
+ * Threads are started for each call and take indices from a shared counter
+ * with the GCC/Clang '__atomic' built-ins, calls are made once a generation
+ * or so which makes the cost of starting the threads negligible. On
+ * platforms without POSIX threads the loop is run by the calling thread. */
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "parallel.h"
+#include "util.h"
+#include "vars.h"
+#include <assert.h>
+#include <stdlib.h>
+
+#define PARALLEL_MAX_THREADS (256u)
+
+typedef struct {
+	parallel_cb cb;
+	void *param;
+	size_t count;
+	size_t next;
+} parallel_t;
+
+static void parallel_run(parallel_t *p) {
+	assert(p);
+	for (;;) {
+		const size_t i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED);
+		if (i >= p->count)
+			return;
+		p->cb(p->param, i);
+	}
+}
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+
+static void *parallel_thread(void *param) {
+	parallel_run(param);
+	return NULL;
+}
+
+unsigned parallel_threads(unsigned threads) {
+	if (!threads) {
+		const long n = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = n > 0 ? n : 1;
+	}
+	return MIN(threads, PARALLEL_MAX_THREADS);
+}
+
+void parallel_for(unsigned threads, size_t count, parallel_cb cb, void *param) {
+	assert(cb);
+	parallel_t p = { .cb = cb, .param = param, .count = count, .next = 0 };
+	threads = MIN(parallel_threads(threads), count);
+	pthread_t ids[PARALLEL_MAX_THREADS];
+	unsigned started = 0;
+	for (; started + 1 < threads; started++) {
+		if (pthread_create(&ids[started], NULL, parallel_thread, &p)) {
+			warning("parallel: could only start %u extra threads", started);
+			break;
+		}
+	}
+	parallel_run(&p);
+	for (unsigned i = 0; i < started; i++)
+		pthread_join(ids[i], NULL);
+}
+
+#else
+
+unsigned parallel_threads(unsigned threads) {
+	UNUSED(threads);
+	return 1;
+}
+
+void parallel_for(unsigned threads, size_t count, parallel_cb cb, void *param) {
+	assert(cb);
+	UNUSED(threads);
+	parallel_t p = { .cb = cb, .param = param, .count = count, .next = 0 };
+	parallel_run(&p);
+}
+
+#endif
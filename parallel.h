@@ -0,0 +1,25 @@
+/** @file       parallel.h
+ *  @brief      Run independent loop iterations on a set of threads
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+/** Called once for each index, possibly concurrently with other indices */
+typedef void (*parallel_cb)(void *param, size_t index);
+
+/** Call 'cb' for every index in [0, count) using up to 'threads' threads,
+ * the calling thread included, and return once all calls have finished.
+ * Zero threads means one per online processor. Which thread runs an index
+ * is not defined, so any randomness 'cb' needs should be seeded from the
+ * index and not depend on the state of the calling thread. */
+void parallel_for(unsigned threads, size_t count, parallel_cb cb, void *param);
+
+/** The number of threads 'parallel_for' would use for a request */
+unsigned parallel_threads(unsigned threads);
+
+#endif
@@ -62,19 +62,20 @@ bool player_is_dead(player_t *p) {
 	return p->health < 0;
 }
 
-cell_t *player_serialize(player_t *p) {
-	assert(p);
-	cell_t *c = printer(
-			"player "
-			"(x %f) (y %f) (orientation %f) (health %f)"
-			"(team %d) (hits %d) (foods %d)"
-			"(energy %f) (score %f)",
-			p->x, p->y, p->orientation, p->health,
-			(intptr_t)(p->team), (intptr_t)(p->hits), (intptr_t)(p->foods),
-			p->energy, p->score
-			);
-	assert(c);
-	return c;
+void player_serialize(player_t *p, emitter_t *e) {
+	assert(p && e);
+	emit_begin(e);
+	emit_symbol(e, "player");
+	emit_item_float(e,   "x",           p->x);
+	emit_item_float(e,   "y",           p->y);
+	emit_item_float(e,   "orientation", p->orientation);
+	emit_item_float(e,   "health",      p->health);
+	emit_item_integer(e, "team",        p->team);
+	emit_item_integer(e, "hits",        p->hits);
+	emit_item_integer(e, "foods",       p->foods);
+	emit_item_float(e,   "energy",      p->energy);
+	emit_item_float(e,   "score",       p->score);
+	emit_end(e);
 }
 
 player_t *player_deserialize(cell_t *c) {
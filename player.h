@@ -23,7 +23,7 @@ player_t *player_new(unsigned team);
 void player_delete(player_t *p);
 void player_update(player_t *p, bool fire, bool left, bool right, bool forward);
 bool player_is_dead(player_t *p);
-cell_t *player_serialize(player_t *p);
+void player_serialize(player_t *p, emitter_t *e);
 player_t *player_deserialize(cell_t *c);
 
 #endif
@@ -38,7 +38,7 @@ bool projectile_is_active(projectile_t *p) {
 
 void projectile_deactivate(projectile_t *p) {
 	assert(p);
-	p->travelled += projectile_range;
+	p->travelled = projectile_range;
 	p->team = (unsigned)-1l;
 	p->color = MAGENTA;
 }
@@ -83,16 +83,16 @@ bool projectile_fire(projectile_t *p, unsigned team, double x, double y, double
 	return true;
 }
 
-cell_t *projectile_serialize(projectile_t *p) {
-	assert(p);
-	cell_t *c = printer("projectile (team %d) (x %f) (y %f) (orientation %f) (travelled %f)",
-			(intptr_t)p->team,
-			p->x,
-			p->y,
-			p->orientation,
-			p->travelled);
-	assert(c);
-	return c;
+void projectile_serialize(projectile_t *p, emitter_t *e) {
+	assert(p && e);
+	emit_begin(e);
+	emit_symbol(e, "projectile");
+	emit_item_integer(e, "team",        p->team);
+	emit_item_float(e,   "x",           p->x);
+	emit_item_float(e,   "y",           p->y);
+	emit_item_float(e,   "orientation", p->orientation);
+	emit_item_float(e,   "travelled",   p->travelled);
+	emit_end(e);
 }
 
 projectile_t *projectile_deserialize(cell_t *c) {
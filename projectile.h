@@ -29,7 +29,7 @@ unsigned projectile_team(projectile_t *p);
 bool projectile_is_active(projectile_t *p);
 bool projectile_fire(projectile_t *p, unsigned team, double x, double y, double orientation, const color_t *color);
 void projectile_deactivate(projectile_t *p);
-cell_t *projectile_serialize(projectile_t *p);
+void projectile_serialize(projectile_t *p, emitter_t *e);
 projectile_t *projectile_deserialize(cell_t *c);
 
 #endif
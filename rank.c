@@ -0,0 +1,85 @@
+/** @file       rank.c
+ *  @brief      Ranking of sort keys without touching what they belong to
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com
+ *
+ * The keys are copied into a contiguous array once, a quick select then
+ * partitions off the entries that are wanted and only those get sorted. */
+#include "rank.h"
+#include "util.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define RANK_SMALL (16u)
+
+static inline bool before(const rank_t *a, const rank_t *b) {
+	if (a->key != b->key)
+		return a->key > b->key;
+	return a->index < b->index;
+}
+
+static inline void swap(rank_t *a, rank_t *b) {
+	const rank_t t = *a;
+	*a = *b;
+	*b = t;
+}
+
+void rank_fill(rank_t *r, const double *keys, size_t count) {
+	assert(r && (keys || !count));
+	for (size_t i = 0; i < count; i++)
+		r[i] = (rank_t){ .key = keys[i], .index = i };
+}
+
+static void insertion_sort(rank_t *r, size_t count) {
+	for (size_t i = 1; i < count; i++)
+		for (size_t j = i; j > 0 && before(&r[j], &r[j - 1]); j--)
+			swap(&r[j], &r[j - 1]);
+}
+
+static int compare(const void *a, const void *b) {
+	if (before(a, b))
+		return -1;
+	return before(b, a);
+}
+
+/* Lomuto partition around the median of the first, middle and last
+ * entries, returns where the pivot ends up */
+static size_t partition(rank_t *r, size_t lo, size_t hi) {
+	const size_t mid = lo + ((hi - lo) / 2), last = hi - 1;
+	if (before(&r[mid], &r[lo]))
+		swap(&r[mid], &r[lo]);
+	if (before(&r[last], &r[lo]))
+		swap(&r[last], &r[lo]);
+	if (before(&r[mid], &r[last]))
+		swap(&r[mid], &r[last]);
+	size_t store = lo;
+	for (size_t i = lo; i < last; i++)
+		if (before(&r[i], &r[last]))
+			swap(&r[i], &r[store++]);
+	swap(&r[store], &r[last]);
+	return store;
+}
+
+void rank_top(rank_t *r, size_t count, size_t k) {
+	assert(r || !count);
+	k = MIN(k, count);
+	if (count <= RANK_SMALL) {
+		insertion_sort(r, count);
+		return;
+	}
+	for (size_t lo = 0, hi = count; k < count && hi - lo > 1;) {
+		const size_t p = partition(r, lo, hi);
+		if (p == k)
+			break;
+		if (p < k)
+			lo = p + 1;
+		else
+			hi = p;
+	}
+	if (k <= RANK_SMALL)
+		insertion_sort(r, k);
+	else
+		qsort(r, k, sizeof(r[0]), compare);
+}
@@ -0,0 +1,26 @@
+/** @file       rank.h
+ *  @brief      Ranking of sort keys without touching what they belong to
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com*/
+
+#ifndef RANK_H
+#define RANK_H
+
+#include <stddef.h>
+
+/** A key and the index of whatever it was taken from, entries are ordered
+ * by descending key and then by ascending index, so ties keep their
+ * original order */
+typedef struct {
+	double key;
+	size_t index;
+} rank_t;
+
+void rank_fill(rank_t *r, const double *keys, size_t count);
+
+/** Move the 'k' highest ranked entries to the front, in order, the order of
+ * the rest is unspecified. Takes O(count + k log k) time on average. */
+void rank_top(rank_t *r, size_t count, size_t k);
+
+#endif
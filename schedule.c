@@ -0,0 +1,307 @@
+/** @file       schedule.c
+ *  @brief      Tournament scheduling; knockout, Swiss and round robin
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com
+ *
+ * The scheduler works on indices into a population of any size and hands
+ * out the whole list of matches for a round at once, so that the matches of
+ * a round can be run in any order or all at the same time. Each match has at
+ * most 'arena' gladiators in it, gladiators that cannot be placed in a full
+ * match are given a bye. The number of wins a gladiator has had in the
+ * current tournament is tracked for use in its fitness; winning means being
+ * in the top half of a match, and a bye counts as a win in the knockout and
+ * Swiss formats. */
+#include "schedule.h"
+#include "rank.h"
+#include "util.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct schedule_t {
+	schedule_method_e method;
+	size_t population, arena;
+	unsigned round, rounds;
+	unsigned *wins;
+	size_t *field, fielded;  /**< gladiators in the current round */
+	size_t *next, advancing; /**< knockout; gladiators going through */
+	size_t *scratch;
+	size_t *members, *sizes, matches, max_matches;
+};
+
+static size_t winners(size_t members) {
+	return MAX(1u, members / 2);
+}
+
+static void shuffle(size_t *xs, size_t count) {
+	for (size_t i = count; i > 1; i--) {
+		const size_t j = random_u64() % i;
+		const size_t t = xs[i - 1];
+		xs[i - 1] = xs[j];
+		xs[j] = t;
+	}
+}
+
+static void add_match(schedule_t *s, const size_t *members, size_t count) {
+	assert(s->matches < s->max_matches && count <= s->arena);
+	memcpy(&s->members[s->matches * s->arena], members, sizeof(members[0]) * count);
+	s->sizes[s->matches++] = count;
+}
+
+/* Consecutive gladiators in the field are put into matches, the remainder
+ * sit this round out */
+static void fill_matches(schedule_t *s) {
+	if (s->fielded <= s->arena) {
+		add_match(s, s->field, s->fielded);
+		return;
+	}
+	const size_t matches = s->fielded / s->arena;
+	for (size_t i = 0; i < matches; i++)
+		add_match(s, &s->field[i * s->arena], s->arena);
+	for (size_t i = matches * s->arena; i < s->fielded; i++) {
+		s->wins[s->field[i]]++;
+		if (s->method == SCHEDULE_KNOCKOUT)
+			s->next[s->advancing++] = s->field[i];
+	}
+}
+
+/* Gladiators are ranked by wins so far, a shuffle followed by a stable
+ * counting sort means ties are broken at random */
+static void swiss_order(schedule_t *s) {
+	shuffle(s->field, s->fielded);
+	size_t *counts = allocate(sizeof(counts[0]) * (s->rounds + 2));
+	for (size_t i = 0; i < s->fielded; i++)
+		counts[s->rounds - MIN(s->rounds, s->wins[s->field[i]]) + 1]++;
+	for (size_t i = 1; i < s->rounds + 2; i++)
+		counts[i] += counts[i - 1];
+	for (size_t i = 0; i < s->fielded; i++)
+		s->scratch[counts[s->rounds - MIN(s->rounds, s->wins[s->field[i]])]++] = s->field[i];
+	memcpy(s->field, s->scratch, sizeof(s->field[0]) * s->fielded);
+	free(counts);
+}
+
+/* The circle method; the first gladiator stays put and the rest rotate by
+ * one place each round, place 'i' meets place 'n - 1 - i'. An odd sized
+ * population has a dummy entry, meeting it is a bye. When more than two
+ * gladiators fit in the arena several pairs share a match, so each pair
+ * still meets at least once. */
+static void round_robin(schedule_t *s) {
+	const size_t n = s->population + (s->population & 1), pairs = n / 2;
+	const size_t per_match = MAX(1u, s->arena / 2);
+	size_t members[s->arena], count = 0;
+	for (size_t i = 0; i < n; i++)
+		s->scratch[i] = i == 0 ? 0 : 1 + ((i - 1 + s->round) % (n - 1));
+	for (size_t i = 0, merged = 0; i < pairs; i++) {
+		const size_t a = s->scratch[i], b = s->scratch[n - 1 - i];
+		if (a >= s->population || b >= s->population)
+			continue;
+		members[count++] = s->field[a];
+		members[count++] = s->field[b];
+		if (++merged == per_match) {
+			add_match(s, members, count);
+			merged = count = 0;
+		}
+	}
+	if (count)
+		add_match(s, members, count);
+}
+
+static void build_round(schedule_t *s) {
+	s->matches = 0;
+	switch (s->method) {
+	case SCHEDULE_KNOCKOUT:
+		shuffle(s->field, s->fielded);
+		s->advancing = 0;
+		fill_matches(s);
+		break;
+	case SCHEDULE_SWISS:
+		swiss_order(s);
+		fill_matches(s);
+		break;
+	case SCHEDULE_ROUND_ROBIN:
+		round_robin(s);
+		break;
+	default:
+		fatal("invalid schedule method %u", s->method);
+	}
+}
+
+static unsigned knockout_rounds(size_t population, size_t arena) {
+	unsigned rounds = 1;
+	for (size_t field = population; field > arena; rounds++) {
+		const size_t matches = field / arena;
+		field = (matches * winners(arena)) + (field - (matches * arena));
+	}
+	return rounds;
+}
+
+schedule_t *schedule_new(schedule_method_e method, size_t population, size_t arena, unsigned rounds) {
+	assert(arena >= 2 && population >= arena);
+	schedule_t *s = allocate(sizeof(*s));
+	s->method     = method;
+	s->population = population;
+	s->arena      = arena;
+	switch (method) {
+	case SCHEDULE_KNOCKOUT:    s->rounds = knockout_rounds(population, arena); break;
+	case SCHEDULE_SWISS:       s->rounds = MAX(1u, rounds); break;
+	case SCHEDULE_ROUND_ROBIN: s->rounds = population + (population & 1) - 1; break;
+	default:
+		fatal("invalid schedule method %u", method);
+	}
+	const size_t pairs = (population + 1) / 2, per_match = MAX(1u, arena / 2);
+	s->max_matches = MAX(population / arena, (pairs + per_match - 1) / per_match);
+	s->wins    = allocate(sizeof(s->wins[0]) * population);
+	s->field   = allocate(sizeof(s->field[0]) * population);
+	s->next    = allocate(sizeof(s->next[0]) * population);
+	s->scratch = allocate(sizeof(s->scratch[0]) * (population + 1));
+	s->members = allocate(sizeof(s->members[0]) * s->max_matches * arena);
+	s->sizes   = allocate(sizeof(s->sizes[0]) * s->max_matches);
+	schedule_restart(s);
+	return s;
+}
+
+void schedule_delete(schedule_t *s) {
+	if (!s)
+		return;
+	free(s->wins);
+	free(s->field);
+	free(s->next);
+	free(s->scratch);
+	free(s->members);
+	free(s->sizes);
+	free(s);
+}
+
+void schedule_restart(schedule_t *s) {
+	assert(s);
+	s->round = 0;
+	s->fielded = s->population;
+	for (size_t i = 0; i < s->population; i++) {
+		s->wins[i] = 0;
+		s->field[i] = i;
+	}
+	if (s->method == SCHEDULE_ROUND_ROBIN)
+		shuffle(s->field, s->fielded);
+	build_round(s);
+}
+
+/* Returns false when the tournament is over */
+bool schedule_next_round(schedule_t *s) {
+	assert(s);
+	if (s->round + 1 >= s->rounds)
+		return false;
+	s->round++;
+	if (s->method == SCHEDULE_KNOCKOUT) {
+		memcpy(s->field, s->next, sizeof(s->field[0]) * s->advancing);
+		s->fielded = s->advancing;
+	}
+	build_round(s);
+	return true;
+}
+
+size_t schedule_matches(const schedule_t *s) {
+	assert(s);
+	return s->matches;
+}
+
+size_t schedule_max_matches(const schedule_t *s) {
+	assert(s);
+	return s->max_matches;
+}
+
+size_t schedule_match(const schedule_t *s, size_t match, const size_t **members) {
+	assert(s && members && match < s->matches);
+	*members = &s->members[match * s->arena];
+	return s->sizes[match];
+}
+
+/* 'fitness' is in the same order as the members of the match */
+void schedule_result(schedule_t *s, size_t match, const double *fitness) {
+	assert(s && fitness);
+	const size_t *members = NULL;
+	const size_t count = schedule_match(s, match, &members);
+	rank_t order[count];
+	rank_fill(order, fitness, count);
+	rank_top(order, count, winners(count));
+	for (size_t i = 0; i < winners(count); i++) {
+		const size_t g = members[order[i].index];
+		s->wins[g]++;
+		if (s->method == SCHEDULE_KNOCKOUT)
+			s->next[s->advancing++] = g;
+	}
+}
+
+unsigned schedule_wins(const schedule_t *s, size_t gladiator) {
+	assert(s && gladiator < s->population);
+	return s->wins[gladiator];
+}
+
+unsigned schedule_round(const schedule_t *s) {
+	assert(s);
+	return s->round;
+}
+
+unsigned schedule_rounds(const schedule_t *s) {
+	assert(s);
+	return s->rounds;
+}
+
+/* The state is laid out as; round, fielded, advancing, matches, then the
+ * wins, field and next arrays, then the size and members of each match */
+size_t schedule_state_length(const schedule_t *s) {
+	assert(s);
+	return 4 + (3 * s->population) + (s->max_matches * (1 + s->arena));
+}
+
+void schedule_state_export(const schedule_t *s, uint64_t *state) {
+	assert(s && state);
+	*state++ = s->round;
+	*state++ = s->fielded;
+	*state++ = s->advancing;
+	*state++ = s->matches;
+	for (size_t i = 0; i < s->population; i++)
+		*state++ = s->wins[i];
+	for (size_t i = 0; i < s->population; i++)
+		*state++ = s->field[i];
+	for (size_t i = 0; i < s->population; i++)
+		*state++ = s->next[i];
+	for (size_t i = 0; i < s->max_matches; i++)
+		*state++ = s->sizes[i];
+	for (size_t i = 0; i < s->max_matches * s->arena; i++)
+		*state++ = s->members[i];
+}
+
+int schedule_state_import(schedule_t *s, const uint64_t *state, size_t length) {
+	assert(s && state);
+	if (length != schedule_state_length(s))
+		return -1;
+	const uint64_t round = state[0], fielded = state[1], advancing = state[2], matches = state[3];
+	if (round >= s->rounds || fielded > s->population || advancing > s->population || matches > s->max_matches)
+		return -1;
+	const uint64_t *wins = &state[4], *field = wins + s->population, *next = field + s->population;
+	const uint64_t *sizes = next + s->population, *members = sizes + s->max_matches;
+	for (size_t i = 0; i < s->population; i++)
+		if (wins[i] > s->rounds || field[i] >= s->population || next[i] >= s->population)
+			return -1;
+	for (size_t i = 0; i < s->max_matches; i++)
+		if (sizes[i] > s->arena)
+			return -1;
+	for (size_t i = 0; i < s->max_matches * s->arena; i++)
+		if (members[i] >= s->population)
+			return -1;
+	s->round     = round;
+	s->fielded   = fielded;
+	s->advancing = advancing;
+	s->matches   = matches;
+	for (size_t i = 0; i < s->population; i++) {
+		s->wins[i]  = wins[i];
+		s->field[i] = field[i];
+		s->next[i]  = next[i];
+	}
+	for (size_t i = 0; i < s->max_matches; i++)
+		s->sizes[i] = sizes[i];
+	for (size_t i = 0; i < s->max_matches * s->arena; i++)
+		s->members[i] = members[i];
+	return 0;
+}
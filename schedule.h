@@ -0,0 +1,45 @@
+/** @file       schedule.h
+ *  @brief      Tournament scheduling; knockout, Swiss and round robin
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com*/
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+	SCHEDULE_KNOCKOUT,    /**< top half of each match go through, until one match is left */
+	SCHEDULE_SWISS,       /**< a fixed number of rounds, gladiators meet those with similar scores */
+	SCHEDULE_ROUND_ROBIN, /**< every gladiator meets every other gladiator */
+} schedule_method_e;
+
+struct schedule_t;
+typedef struct schedule_t schedule_t;
+
+schedule_t *schedule_new(schedule_method_e method, size_t population, size_t arena, unsigned rounds);
+void schedule_delete(schedule_t *s);
+void schedule_restart(schedule_t *s);
+bool schedule_next_round(schedule_t *s);
+
+size_t schedule_matches(const schedule_t *s);
+size_t schedule_max_matches(const schedule_t *s);
+size_t schedule_match(const schedule_t *s, size_t match, const size_t **members);
+void schedule_result(schedule_t *s, size_t match, const double *fitness);
+
+unsigned schedule_wins(const schedule_t *s, size_t gladiator);
+unsigned schedule_round(const schedule_t *s);
+unsigned schedule_rounds(const schedule_t *s);
+
+/** The state of a tournament in progress as 64-bit words, so that it can be
+ * saved and carried on with exactly. The state can only be imported into a
+ * schedule made with the same arguments, 'schedule_state_import' returns
+ * negative if it does not fit. */
+size_t schedule_state_length(const schedule_t *s);
+void schedule_state_export(const schedule_t *s, uint64_t *state);
+int schedule_state_import(schedule_t *s, const uint64_t *state, size_t length);
+
+#endif
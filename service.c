@@ -0,0 +1,280 @@
+/** @file       service.c
+ *  @brief      Genome evaluation service over a Unix domain socket
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com
+ *
+ * A long running headless mode in which external programs can submit
+ * genomes for evaluation without linking against this program. Requests
+ * and responses are S-Expressions, one client is served at a time and the
+ * requests from a client are handled in order:
+ *
+ * 	(evaluate
+ * 		(id 1)
+ * 		(configuration (item "max_ticks_per_generation" 1000.0) ...)
+ * 		(genomes (brain ...) (genome 0.1 -2.5 ...) ...)
+ * 		(opponents (brain ...) ...))
+ *
+ * The configuration is optional and only applies to that batch. Genomes
+ * and opponents can either be given in the format produced by
+ * 'brain_serialize' or as a flat list of parameters in the order produced
+ * by 'brain_genome_export'. A result is streamed back for each genome as
+ * soon as all of its matches are complete, followed by a done message:
+ *
+ * 	(result (id 1) (genome 0) (matches 4) (hits 1.5) (foods 0.0) ...)
+ * 	(done (id 1) (genomes 8))
+ *
+ * Failures are reported with '(error (id 1) "reason")', and '(quit)' stops
+ * the service. */
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "service.h"
+#include "brain.h"
+#include "sexpr.h"
+#include "util.h"
+#include "vars.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+struct service_t {
+	FILE *out;
+};
+
+static int reply(service_t *s, cell_t *c) {
+	assert(s && c);
+	int r = write_s_expression_to_file(c, s->out);
+	cell_delete(c);
+	if (r < 0 || fputc('\n', s->out) < 0 || fflush(s->out) < 0)
+		return -1;
+	return 0;
+}
+
+static int reply_error(service_t *s, intptr_t id, const char *msg) {
+	warning("service: %s", msg);
+	return reply(s, printer("error (id %d) %s", id, msg));
+}
+
+int service_result(service_t *s, const service_batch_t *b, size_t genome, size_t matches, const double state[GLADIATOR_STATE_LAST], double fitness) {
+	assert(s && b && state);
+	return reply(s, printer(
+		"result (id %d) (genome %d) (matches %d) "
+		"(hits %f) (foods %f) (health %f) (energy %f) (fired %f) "
+		"(time-alive %f) (wall-contact %f) (stalemate %f) (fitness %f)",
+		b->id, (intptr_t)genome, (intptr_t)matches,
+		state[GLADIATOR_STATE_HITS], state[GLADIATOR_STATE_FOODS],
+		state[GLADIATOR_STATE_HEALTH], state[GLADIATOR_STATE_ENERGY],
+		state[GLADIATOR_STATE_FIRED], state[GLADIATOR_STATE_TIME_ALIVE],
+		state[GLADIATOR_STATE_WALL_CONTACT], state[GLADIATOR_STATE_STALEMATE], fitness));
+}
+
+static bool is_symbol(cell_t *c, const char *sym) {
+	return type(c) == SYMBOL && SYM(c) == intern(sym, strlen(sym));
+}
+
+static int genome_deserialize(cell_t *c, double *genome, size_t length) {
+	assert(c && genome);
+	if (type(c) != CONS)
+		return -1;
+	if (is_symbol(car(c), "brain")) {
+		brain_t *b = brain_deserialize(c);
+		if (!b)
+			return -1;
+		int r = -1;
+		if (brain_genome_length(b) == length) {
+			brain_genome_export(b, genome);
+			r = 0;
+		}
+		brain_delete(b);
+		return r;
+	}
+	if (!is_symbol(car(c), "genome"))
+		return -1;
+	size_t i = 0;
+	for (c = cdr(c); type(c) != NIL && i < length; c = cdr(c), i++) {
+		cell_t *v = car(c);
+		if (type(v) == FLOATING)
+			genome[i] = FLT(v);
+		else if (type(v) == INTEGER)
+			genome[i] = INT(v);
+		else
+			return -1;
+	}
+	return (i == length && type(c) == NIL) ? 0 : -1;
+}
+
+static double *genomes_deserialize(cell_t *list, size_t length, size_t *count) {
+	assert(list && count);
+	*count = cell_length(list) - 1;
+	if (!*count)
+		return NULL;
+	double *genomes = allocate(sizeof(genomes[0]) * length * *count);
+	size_t i = 0;
+	for (list = cdr(list); type(list) != NIL; list = cdr(list), i++) {
+		if (genome_deserialize(car(list), &genomes[i * length], length) < 0) {
+			free(genomes);
+			return NULL;
+		}
+	}
+	return genomes;
+}
+
+static int evaluate(service_t *s, cell_t *c, service_evaluate_cb cb, void *param) {
+	assert(s && c && cb);
+	cell_t *configuration = NULL, *genomes = NULL, *opponents = NULL, *saved = NULL;
+	service_batch_t b = { .id = 0 };
+	int r = -1;
+	for (cell_t *i = cdr(c); type(i) != NIL; i = cdr(i)) {
+		cell_t *item = car(i);
+		if (type(item) != CONS)
+			return reply_error(s, b.id, "invalid request item");
+		cell_t *name = car(item);
+		if (is_symbol(name, "id") && type(CADR(item)) == INTEGER)
+			b.id = INT(CADR(item));
+		else if (is_symbol(name, "configuration"))
+			configuration = item;
+		else if (is_symbol(name, "genomes"))
+			genomes = item;
+		else if (is_symbol(name, "opponents"))
+			opponents = item;
+		else
+			return reply_error(s, b.id, "unknown request item");
+	}
+	if (!genomes || !opponents)
+		return reply_error(s, b.id, "genomes and opponents are required");
+	if (configuration) {
+		saved = config_serialize();
+		if (config_deserialize(configuration) < 0) {
+			r = reply_error(s, b.id, "invalid configuration");
+			goto done;
+		}
+	}
+	b.genome_length = gladiator_genome_length();
+	b.genome   = genomes_deserialize(genomes, b.genome_length, &b.genomes);
+	b.opponent = genomes_deserialize(opponents, b.genome_length, &b.opponents);
+	if (!b.genome || !b.opponent) {
+		r = reply_error(s, b.id, "invalid or empty genome list");
+		goto done;
+	}
+	if (cb(param, s, &b) < 0) {
+		r = reply_error(s, b.id, "evaluation failed");
+		goto done;
+	}
+	r = reply(s, printer("done (id %d) (genomes %d)", b.id, (intptr_t)b.genomes));
+done:
+	if (saved && config_deserialize(saved) < 0)
+		warning("service: failed to restore configuration");
+	cell_delete(saved);
+	free(b.genome);
+	free(b.opponent);
+	return r;
+}
+
+/* Returns a positive number if the service has been asked to quit */
+static int serve(int fd, service_evaluate_cb cb, void *param) {
+	const int fd2 = dup(fd);
+	FILE *in = fdopen(fd, "rb"), *out = fd2 < 0 ? NULL : fdopen(fd2, "wb");
+	int r = 0;
+	if (!in || !out) {
+		warning("service: fdopen failed: %s", strerror(errno));
+		r = -1;
+		goto done;
+	}
+	service_t s = { .out = out };
+	for (;;) { /* each request is read into its own arena */
+		cell_arena_t *a = cell_arena_new();
+		cell_t *c = read_s_expression_from_file_arena(in, a);
+		int e = 0;
+		if (!c) {
+			e = -1;
+		} else if (type(c) == CONS && is_symbol(car(c), "quit")) {
+			r = 1;
+			e = -1;
+		} else if (type(c) != CONS || !is_symbol(car(c), "evaluate")) {
+			e = reply_error(&s, 0, "unknown request");
+		} else {
+			e = evaluate(&s, c, cb, param);
+		}
+		cell_arena_delete(a);
+		if (e < 0)
+			break;
+	}
+done:
+	if (in)
+		fclose(in);
+	else
+		close(fd);
+	if (out)
+		fclose(out);
+	else if (fd2 >= 0)
+		close(fd2);
+	return r;
+}
+
+int service_run(const char *path, service_evaluate_cb cb, void *param) {
+	assert(path && cb);
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		warning("service: socket path too long '%s'", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		warning("service: socket failed: %s", strerror(errno));
+		return -1;
+	}
+	unlink(path);
+	if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 8) < 0) {
+		warning("service: could not listen on '%s': %s", path, strerror(errno));
+		close(listener);
+		return -1;
+	}
+	signal(SIGPIPE, SIG_IGN); /* a client going away is not fatal */
+	note("service listening on '%s'", path);
+	int r = 0;
+	for (;;) {
+		const int fd = accept(listener, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			warning("service: accept failed: %s", strerror(errno));
+			r = -1;
+			break;
+		}
+		if (serve(fd, cb, param) > 0)
+			break;
+	}
+	close(listener);
+	unlink(path);
+	return r;
+}
+
+#else
+
+struct service_t {
+	int unused;
+};
+
+int service_run(const char *path, service_evaluate_cb cb, void *param) {
+	UNUSED(path); UNUSED(cb); UNUSED(param);
+	warning("the evaluation service is not supported on this platform");
+	return -1;
+}
+
+int service_result(service_t *s, const service_batch_t *b, size_t genome, size_t matches, const double state[GLADIATOR_STATE_LAST], double fitness) {
+	UNUSED(s); UNUSED(b); UNUSED(genome); UNUSED(matches); UNUSED(state); UNUSED(fitness);
+	return -1;
+}
+
+#endif
@@ -0,0 +1,33 @@
+/** @file       service.h
+ *  @brief      Genome evaluation service over a Unix domain socket
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com*/
+
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gladiator.h"
+
+struct service_t;
+typedef struct service_t service_t;
+
+typedef struct {
+	intptr_t id;            /**< identifier supplied by the client */
+	size_t genome_length;   /**< length of every genome in this batch */
+	size_t genomes;         /**< number of genomes to evaluate */
+	size_t opponents;       /**< number of opponents to evaluate them against */
+	double *genome;         /**< genomes * genome_length parameters */
+	double *opponent;       /**< opponents * genome_length parameters */
+} service_batch_t;
+
+/** Evaluate a batch, calling 'service_result' for each genome as soon as
+ * all of its matches are complete. */
+typedef int (*service_evaluate_cb)(void *param, service_t *s, const service_batch_t *b);
+
+int service_run(const char *path, service_evaluate_cb cb, void *param);
+int service_result(service_t *s, const service_batch_t *b, size_t genome, size_t matches, const double state[GLADIATOR_STATE_LAST], double fitness);
+
+#endif
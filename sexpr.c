@@ -1,59 +1,254 @@
+/** @file       sexpr.c
+ *  @brief      S-Expression parsing and manipulation
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com
+ *
+ * Input is either read a character at a time from a stream, so that
+ * several expressions can be read one after another from a socket, or
+ * scanned directly out of a buffer, which is much faster. Files that are
+ * read in their entirety are mapped into memory and scanned as a buffer. */
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "sexpr.h"
 #include "util.h"
 #include <ctype.h>
 #include <errno.h>
+#include <float.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define CELL_ARENA_CHUNK (64u * 1024u)
+
+typedef struct chunk_t {
+	struct chunk_t *next;
+	size_t used, size;
+	uint64_t data[]; /* aligned for a cell */
+} chunk_t;
+
+struct cell_arena_t {
+	chunk_t *chunks;
+};
+
+/* Lists are built, and walked, with explicit stacks instead of recursion
+ * so how long or deeply nested they are is bounded only by memory */
+typedef struct {
+	cell_t *head, *tail; /* first and last cell of a list being built */
+} list_t;
+
 typedef struct {
 	unsigned line_number;
-	bool string_input;
-	const char *s;
+	const char *s, *end; /* buffer input, used if there is no stream */
 	bool unget;
 	int ungetc;
 	FILE *f;
+	cell_arena_t *arena;
+	list_t *lists;       /* lists still open */
+	size_t depth, lists_size;
 } lexer_t;
 
-static lexer_t *lexer_new(FILE *fin, const char *sin) {
+static lexer_t *lexer_new(FILE *fin, const char *sin, size_t length, cell_arena_t *arena) {
 	assert((!!fin) ^ (!!sin));
 	lexer_t *l = allocate(sizeof(*l));
 	l->s = sin;
+	l->end = sin + length;
 	l->f = fin;
-	l->string_input = !!sin;
+	l->arena = arena;
 	return l;
 }
 
 static void lexer_delete(lexer_t *l) {
+	if (!l)
+		return;
+	free(l->lists);
 	free(l);
 }
 
 static int get_char(lexer_t *l) {
 	int c;
 	assert(l);
-	if (l->unget) {
+	if (!l->f) {
+		if (l->s == l->end || !*l->s)
+			return EOF;
+		c = (unsigned char)*(l->s++);
+	} else if (l->unget) {
 		l->unget = false;
 		c = l->ungetc;
-	} else if (l->string_input) {
-		if (!(c = *(l->s++)))
-			return EOF;
 	} else {
-		c = fgetc(l->f);
+		c = getc(l->f);
 	}
 	if (c == '\n')
 		l->line_number++;
 	return c;
 }
 
+/* Only the last character read can be put back */
 static int unget_char(lexer_t *l, int c) {
-	assert(l && !(l->unget));
+	assert(l);
+	if (c == '\n')
+		l->line_number--;
+	if (!l->f) {
+		if (c != EOF)
+			l->s--;
+		return c;
+	}
+	assert(!(l->unget));
 	l->unget = true;
 	l->ungetc = c;
-	if (l->ungetc == '\n')
-		l->line_number--;
 	return c;
 }
 
+static bool is_space(int ch) {
+	return ch == ' ' || ch == '\n' || ch == '\t';
+}
+
+static bool is_delimiter(int ch) {
+	return ch == EOF || is_space(ch) || ch == '(' || ch == ')';
+}
+
+cell_arena_t *cell_arena_new(void) {
+	return allocate(sizeof(cell_arena_t));
+}
+
+void cell_arena_delete(cell_arena_t *a) {
+	if (!a)
+		return;
+	for (chunk_t *c = a->chunks, *next = NULL; c; c = next) {
+		next = c->next;
+		free(c);
+	}
+	free(a);
+}
+
+size_t cell_arena_size(const cell_arena_t *a) {
+	assert(a);
+	size_t size = 0;
+	for (const chunk_t *c = a->chunks; c; c = c->next)
+		size += c->size;
+	return size;
+}
+
+/* Chunks double in size, so there are only ever a few dozen of them */
+static void *arena_allocate(cell_arena_t *a, size_t size) {
+	assert(a);
+	size = (size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+	chunk_t *c = a->chunks;
+	if (!c || c->size - c->used < size) {
+		const size_t previous = c ? c->size * 2 : CELL_ARENA_CHUNK;
+		const size_t chunk = MAX(previous, size);
+		c = allocate(sizeof(*c) + chunk);
+		c->size = chunk;
+		c->next = a->chunks;
+		a->chunks = c;
+	}
+	void *r = (unsigned char*)c->data + c->used;
+	c->used += size;
+	return r;
+}
+
+static void *stack_reserve(void *stack, size_t used, size_t *size, size_t element) {
+	assert(size && element);
+	if (used < *size)
+		return stack;
+	*size = *size ? *size * 2 : 16;
+	void *n = realloc(stack, *size * element);
+	if (!n)
+		fatal("allocation failed of size %zu\n", *size * element);
+	return n;
+}
+
+static char *string_new(cell_arena_t *a, const char *s, size_t length) {
+	char *r = NULL;
+	if (a) {
+		r = arena_allocate(a, length + 1);
+		r[length] = '\0';
+	} else {
+		r = allocate(length + 1);
+	}
+	memcpy(r, s, length);
+	return r;
+}
+
+/* Symbols are interned in an open addressed hash table, their names are
+ * kept in an arena of their own which is never freed. */
+typedef struct {
+	uint64_t hash;
+	const char *name;
+} symbol_t;
+
+static struct {
+	symbol_t *table;
+	size_t used, size; /* size is a power of two */
+	cell_arena_t *names;
+} symbols;
+
+static uint64_t symbol_hash(const char *s, size_t length) {
+	return hash64(s, length, 0);
+}
+
+static symbol_t *symbol_slot(uint64_t hash, const char *s, size_t length) {
+	assert(symbols.size);
+	const size_t mask = symbols.size - 1;
+	for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+		symbol_t *y = &symbols.table[i];
+		if (!y->name || (y->hash == hash && !memcmp(y->name, s, length) && !y->name[length]))
+			return y;
+	}
+}
+
+static void symbols_grow(void) {
+	const symbol_t *old = symbols.table;
+	const size_t size = symbols.size;
+	symbols.size = size ? size * 2 : 256;
+	symbols.table = allocate(sizeof(symbols.table[0]) * symbols.size);
+	const size_t mask = symbols.size - 1;
+	for (size_t i = 0; i < size; i++) {
+		if (!old[i].name)
+			continue;
+		size_t j = old[i].hash & mask;
+		while (symbols.table[j].name)
+			j = (j + 1) & mask;
+		symbols.table[j] = old[i];
+	}
+	free((void*)old);
+}
+
+const char *intern_find(const char *s, size_t length) {
+	assert(s);
+	if (!symbols.used)
+		return NULL;
+	return symbol_slot(symbol_hash(s, length), s, length)->name;
+}
+
+const char *intern(const char *s, size_t length) {
+	assert(s);
+	if ((symbols.used + 1) * 2 > symbols.size)
+		symbols_grow();
+	const uint64_t hash = symbol_hash(s, length);
+	symbol_t *y = symbol_slot(hash, s, length);
+	if (y->name)
+		return y->name;
+	if (!symbols.names)
+		symbols.names = cell_arena_new();
+	y->hash = hash;
+	y->name = string_new(symbols.names, s, length);
+	symbols.used++;
+	return y->name;
+}
+
 cell_type_e type(cell_t *cell) {
 	assert(cell);
 	return cell->type;
@@ -84,38 +279,60 @@ void setcdr(cell_t *cons, cell_t *cdr) {
 	cons->p.cons.cdr = cdr;
 }
 
-cell_t *cell_new(cell_type_e type) {
+/* Cells from an arena are not freeable, they are released along with the
+ * arena, and as a tree from an arena only holds cells from the same arena
+ * 'cell_delete' can stop as soon as it finds one. */
+static cell_t *cell_alloc(cell_arena_t *a, cell_type_e type) {
 	assert(type < INVALID_CELL_TYPE);
-	cell_t *c = allocate(sizeof(*c));
+	cell_t *c = NULL;
+	if (a) {
+		c = arena_allocate(a, sizeof(*c));
+		memset(c, 0, sizeof(*c));
+	} else {
+		c = allocate(sizeof(*c));
+		c->freeable = true;
+	}
 	c->type = type;
-	c->freeable = true;
 	return c;
 }
 
-cell_t *mkfloat(double x) {
-	cell_t *d = cell_new(FLOATING);
+cell_t *cell_new(cell_type_e type) {
+	return cell_alloc(NULL, type);
+}
+
+static cell_t *mkfloat_in(cell_arena_t *a, double x) {
+	cell_t *d = cell_alloc(a, FLOATING);
 	d->p.floating = x;
 	return d;
 }
 
-cell_t *mkint(intptr_t x) {
-	cell_t *d = cell_new(INTEGER);
+static cell_t *mkint_in(cell_arena_t *a, intptr_t x) {
+	cell_t *d = cell_alloc(a, INTEGER);
 	d->p.integer = x;
 	return d;
 }
 
-cell_t *mkstr(const char *s) {
+static cell_t *mkstring_in(cell_arena_t *a, cell_type_e type, const char *s) {
 	assert(s);
-	cell_t *d = cell_new(STRING);
-	d->p.string = duplicate(s);
+	cell_t *d = cell_alloc(a, type);
+	d->p.string = type == SYMBOL ? (char*)intern(s, strlen(s)) : string_new(a, s, strlen(s));
 	return d;
 }
 
+cell_t *mkfloat(double x) {
+	return mkfloat_in(NULL, x);
+}
+
+cell_t *mkint(intptr_t x) {
+	return mkint_in(NULL, x);
+}
+
+cell_t *mkstr(const char *s) {
+	return mkstring_in(NULL, STRING, s);
+}
+
 cell_t *mksym(const char *s) {
-	assert(s);
-	cell_t *d = cell_new(SYMBOL);
-	d->p.string = duplicate(s);
-	return d;
+	return mkstring_in(NULL, SYMBOL, s);
 }
 
 cell_t *cons(cell_t *car, cell_t *cdr) {
@@ -158,6 +375,7 @@ bool cell_eq(cell_t *a, cell_t *b) {
 	case FLOATING:
 		return a->p.floating == b->p.floating;
 	case SYMBOL:
+		return a->p.string == b->p.string;
 	case STRING:
 		return !strcmp(a->p.string, b->p.string);
 	case CONS:
@@ -185,39 +403,64 @@ cell_t *nth(cell_t *c, size_t n) {
 	return type(c) == NIL ? c : car(c);
 }
 
-void cell_delete(cell_t *cell) {
-	if (!cell)
-		return;
+static void atom_delete(cell_t *cell) {
 	switch (cell->type) {
 	case NIL:
 		return;
 	case INTEGER:
 	case FLOATING:
-		if (cell->freeable)
-			free(cell);
-		return;
 	case SYMBOL:
-	case STRING:
-		if (cell->freeable) {
-		      free(cell->p.string);
-		      free(cell);
-		}
+		free(cell);
 		return;
-	case CONS:
-		cell_delete(cell->p.cons.car);
-		cell_delete(cell->p.cons.cdr);
-		if (cell->freeable)
-		      free(cell);
+	case STRING:
+		free(cell->p.string);
+		free(cell);
 		return;
 	default:
 		fatal("unknown type '%u'", cell->type);
 	}
 }
 
+/* Nested lists are rotated into the list that contains them until the head
+ * of the list is an atom, so the whole tree is freed in one loop without
+ * recursing or allocating: ((a b) c) becomes (a (b c)) */
+void cell_delete(cell_t *cell) {
+	while (cell && cell->freeable) {
+		if (cell->type != CONS) {
+			atom_delete(cell);
+			return;
+		}
+		cell_t *car = cell->p.cons.car;
+		if (car && car->freeable && car->type == CONS) {
+			cell->p.cons.car = car->p.cons.cdr;
+			car->p.cons.cdr = cell;
+			cell = car;
+			continue;
+		}
+		if (car && car->freeable)
+			atom_delete(car);
+		cell_t *cdr = cell->p.cons.cdr;
+		free(cell);
+		cell = cdr;
+	}
+}
+
+static void list_append(cell_arena_t *a, list_t *t, cell_t *v) {
+	assert(t);
+	cell_t *c = cell_alloc(a, CONS);
+	c->p.cons.car = v;
+	c->p.cons.cdr = nil();
+	if (t->tail)
+		t->tail->p.cons.cdr = c;
+	else
+		t->head = c;
+	t->tail = c;
+}
+
 static cell_t *parse_string(lexer_t *l) {
 	assert(l);
 	char s[CELL_MAX_STRING_LENGTH] = {0};
-	cell_t *c = cell_new(STRING);
+	cell_t *c = cell_alloc(l->arena, STRING);
 	for (size_t i = 0; i < CELL_MAX_STRING_LENGTH - 1; i++) {
 		int ch = get_char(l);
 		switch (ch) {
@@ -225,7 +468,7 @@ static cell_t *parse_string(lexer_t *l) {
 			fprintf(stderr, "unexpected EOF on line %u\n", l->line_number);
 			goto fail;
 		case '"':
-			c->p.string = duplicate(s);
+			c->p.string = string_new(l->arena, s, i);
 			return c;
 		case '\\':
 		{
@@ -254,206 +497,879 @@ fail:
 	return NULL;
 }
 
-static cell_t *parse_symbol_or_number(lexer_t *l) {
-	assert(l);
-	char s[CELL_MAX_STRING_LENGTH] = {0};
-	cell_t *c = cell_new(SYMBOL);
-	for (size_t i = 0; i < CELL_MAX_STRING_LENGTH - 1; i++) {
-		int ch = get_char(l);
-		switch (ch) {
-		case EOF:
-		case ' ':
-		case '\n':
-		case '\t':
-		case '(':
-		case ')':
-		{
-			unget_char(l, ch);
-			char *end = s;
-			errno = 0;
-			c->p.integer = strtol(s, &end, 0);
-			if (!*end && !errno) {
+static bool prefixed(const char *s, size_t length, const char *prefix) {
+	for (size_t i = 0; prefix[i]; i++)
+		if (i >= length || tolower((unsigned char)s[i]) != prefix[i])
+			return false;
+	return true;
+}
+
+/* Floating point numbers are written out with the fewest digits that read
+ * back as exactly the same double, using the Grisu2 algorithm (Florian
+ * Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with
+ * Integers", 2010). Grisu2 always round trips but very occasionally, for
+ * well under one percent of doubles, gives a digit more than is needed.
+ *
+ * A number is held as 'f * 2^e' with a 64-bit significand, multiplied by a
+ * cached power of ten to bring it into a range where its digits can be
+ * generated with integer arithmetic. The cached powers are 10^k for k =
+ * -348, -340, ..., 340, normalized and rounded to 64 bits. */
+typedef struct {
+	uint64_t f;
+	int e;
+} diy_fp_t;
+
+static const uint64_t cached_powers_f[] = {
+	0xfa8fd5a0081c0288uLL, 0xbaaee17fa23ebf76uLL, 0x8b16fb203055ac76uLL,
+	0xcf42894a5dce35eauLL, 0x9a6bb0aa55653b2duLL, 0xe61acf033d1a45dfuLL,
+	0xab70fe17c79ac6cauLL, 0xff77b1fcbebcdc4fuLL, 0xbe5691ef416bd60cuLL,
+	0x8dd01fad907ffc3cuLL, 0xd3515c2831559a83uLL, 0x9d71ac8fada6c9b5uLL,
+	0xea9c227723ee8bcbuLL, 0xaecc49914078536duLL, 0x823c12795db6ce57uLL,
+	0xc21094364dfb5637uLL, 0x9096ea6f3848984fuLL, 0xd77485cb25823ac7uLL,
+	0xa086cfcd97bf97f4uLL, 0xef340a98172aace5uLL, 0xb23867fb2a35b28euLL,
+	0x84c8d4dfd2c63f3buLL, 0xc5dd44271ad3cdbauLL, 0x936b9fcebb25c996uLL,
+	0xdbac6c247d62a584uLL, 0xa3ab66580d5fdaf6uLL, 0xf3e2f893dec3f126uLL,
+	0xb5b5ada8aaff80b8uLL, 0x87625f056c7c4a8buLL, 0xc9bcff6034c13053uLL,
+	0x964e858c91ba2655uLL, 0xdff9772470297ebduLL, 0xa6dfbd9fb8e5b88fuLL,
+	0xf8a95fcf88747d94uLL, 0xb94470938fa89bcfuLL, 0x8a08f0f8bf0f156buLL,
+	0xcdb02555653131b6uLL, 0x993fe2c6d07b7facuLL, 0xe45c10c42a2b3b06uLL,
+	0xaa242499697392d3uLL, 0xfd87b5f28300ca0euLL, 0xbce5086492111aebuLL,
+	0x8cbccc096f5088ccuLL, 0xd1b71758e219652cuLL, 0x9c40000000000000uLL,
+	0xe8d4a51000000000uLL, 0xad78ebc5ac620000uLL, 0x813f3978f8940984uLL,
+	0xc097ce7bc90715b3uLL, 0x8f7e32ce7bea5c70uLL, 0xd5d238a4abe98068uLL,
+	0x9f4f2726179a2245uLL, 0xed63a231d4c4fb27uLL, 0xb0de65388cc8ada8uLL,
+	0x83c7088e1aab65dbuLL, 0xc45d1df942711d9auLL, 0x924d692ca61be758uLL,
+	0xda01ee641a708deauLL, 0xa26da3999aef774auLL, 0xf209787bb47d6b85uLL,
+	0xb454e4a179dd1877uLL, 0x865b86925b9bc5c2uLL, 0xc83553c5c8965d3duLL,
+	0x952ab45cfa97a0b3uLL, 0xde469fbd99a05fe3uLL, 0xa59bc234db398c25uLL,
+	0xf6c69a72a3989f5cuLL, 0xb7dcbf5354e9beceuLL, 0x88fcf317f22241e2uLL,
+	0xcc20ce9bd35c78a5uLL, 0x98165af37b2153dfuLL, 0xe2a0b5dc971f303auLL,
+	0xa8d9d1535ce3b396uLL, 0xfb9b7cd9a4a7443cuLL, 0xbb764c4ca7a44410uLL,
+	0x8bab8eefb6409c1auLL, 0xd01fef10a657842cuLL, 0x9b10a4e5e9913129uLL,
+	0xe7109bfba19c0c9duLL, 0xac2820d9623bf429uLL, 0x80444b5e7aa7cf85uLL,
+	0xbf21e44003acdd2duLL, 0x8e679c2f5e44ff8fuLL, 0xd433179d9c8cb841uLL,
+	0x9e19db92b4e31ba9uLL, 0xeb96bf6ebadf77d9uLL, 0xaf87023b9bf0ee6buLL,
+};
+
+static const int16_t cached_powers_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+	-954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+	-688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+	-422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+	-157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+	109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+	641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+	907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const uint64_t powers_of_ten[] = {
+	1uLL, 10uLL, 100uLL, 1000uLL, 10000uLL, 100000uLL, 1000000uLL,
+	10000000uLL, 100000000uLL, 1000000000uLL, 10000000000uLL,
+	100000000000uLL, 1000000000000uLL, 10000000000000uLL,
+	100000000000000uLL, 1000000000000000uLL, 10000000000000000uLL,
+	100000000000000000uLL, 1000000000000000000uLL, 10000000000000000000uLL,
+};
+
+#define DP_SIGNIFICAND_MASK (0x000FFFFFFFFFFFFFuLL)
+#define DP_EXPONENT_MASK    (0x7FF0000000000000uLL)
+#define DP_HIDDEN_BIT       (0x0010000000000000uLL)
+#define DP_EXPONENT_BIAS    (0x3FF + 52)
+
+static diy_fp_t diy_fp_multiply(diy_fp_t x, diy_fp_t y) {
+	const uint64_t m32 = 0xFFFFFFFFu;
+	const uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+	const uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+	tmp += 1u << 31; /* round */
+	return (diy_fp_t) { ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64 };
+}
+
+static diy_fp_t diy_fp_normalize(diy_fp_t x) {
+	assert(x.f);
+	while (!(x.f & (1uLL << 63))) {
+		x.f <<= 1;
+		x.e--;
+	}
+	return x;
+}
+
+/* The boundaries halfway to the neighbouring doubles, any number between
+ * them reads back as 'v' */
+static void diy_fp_boundaries(diy_fp_t v, diy_fp_t *minus, diy_fp_t *plus) {
+	diy_fp_t p = { (v.f << 1) + 1, v.e - 1 };
+	while (!(p.f & (DP_HIDDEN_BIT << 1))) {
+		p.f <<= 1;
+		p.e--;
+	}
+	p.f <<= 64 - 52 - 2;
+	p.e  -= 64 - 52 - 2;
+	diy_fp_t m = v.f == DP_HIDDEN_BIT ?
+		(diy_fp_t) { (v.f << 2) - 1, v.e - 2 } :
+		(diy_fp_t) { (v.f << 1) - 1, v.e - 1 };
+	m.f <<= m.e - p.e;
+	m.e = p.e;
+	*plus = p;
+	*minus = m;
+}
+
+static diy_fp_t cached_power(int e, int *k) {
+	const double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int ik = (int)dk;
+	if (dk - ik > 0.0)
+		ik++;
+	const unsigned index = (unsigned)((ik >> 3) + 1);
+	assert(index < sizeof(cached_powers_f)/sizeof(cached_powers_f[0]));
+	*k = -(-348 + (int)(index << 3));
+	return (diy_fp_t) { cached_powers_f[index], cached_powers_e[index] };
+}
+
+static void grisu_round(char *buffer, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+	while (rest < wp_w && delta - rest >= ten_kappa &&
+			(rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+		buffer[length - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+static int count_digits(uint32_t n) {
+	int digits = 1;
+	for (; n >= 10; n /= 10)
+		digits++;
+	return digits;
+}
+
+static int digit_generate(diy_fp_t w, diy_fp_t mp, uint64_t delta, char *buffer, int *k) {
+	const diy_fp_t one = { 1uLL << -mp.e, mp.e };
+	const uint64_t wp_w = mp.f - w.f;
+	uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+	uint64_t p2 = mp.f & (one.f - 1);
+	int kappa = count_digits(p1), length = 0;
+	while (kappa > 0) {
+		const uint32_t power = (uint32_t)powers_of_ten[kappa - 1];
+		const uint32_t d = p1 / power;
+		p1 %= power;
+		if (d || length)
+			buffer[length++] = '0' + d;
+		kappa--;
+		const uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+		if (rest <= delta) {
+			*k += kappa;
+			grisu_round(buffer, length, delta, rest, powers_of_ten[kappa] << -one.e, wp_w);
+			return length;
+		}
+	}
+	for (;;) {
+		p2 *= 10;
+		delta *= 10;
+		const char d = (char)(p2 >> -one.e);
+		if (d || length)
+			buffer[length++] = '0' + d;
+		p2 &= one.f - 1;
+		kappa--;
+		if (p2 < delta) {
+			*k += kappa;
+			const int index = -kappa;
+			grisu_round(buffer, length, delta, p2, one.f, index < 20 ? wp_w * powers_of_ten[index] : 0);
+			return length;
+		}
+	}
+}
+
+/* The digits of a positive, finite, non zero 'x' are put into 'buffer', the
+ * number is 'buffer * 10^k' */
+static int grisu2(double x, char *buffer, int *k) {
+	assert(x > 0);
+	uint64_t u = 0;
+	memcpy(&u, &x, sizeof(u));
+	const int biased = (int)((u & DP_EXPONENT_MASK) >> 52);
+	const uint64_t significand = u & DP_SIGNIFICAND_MASK;
+	const diy_fp_t v = biased ?
+		(diy_fp_t) { significand + DP_HIDDEN_BIT, biased - DP_EXPONENT_BIAS } :
+		(diy_fp_t) { significand, 1 - DP_EXPONENT_BIAS };
+	diy_fp_t minus, plus;
+	diy_fp_boundaries(v, &minus, &plus);
+	const diy_fp_t c = cached_power(plus.e, k);
+	const diy_fp_t w = diy_fp_multiply(diy_fp_normalize(v), c);
+	diy_fp_t wp = diy_fp_multiply(plus, c), wm = diy_fp_multiply(minus, c);
+	wm.f++;
+	wp.f--;
+	return digit_generate(w, wp, wp.f - wm.f, buffer, k);
+}
+
+static size_t exponent_format(char *s, int exponent) {
+	size_t i = 0;
+	s[i++] = 'e';
+	if (exponent < 0) {
+		s[i++] = '-';
+		exponent = -exponent;
+	}
+	if (exponent >= 100)
+		s[i++] = '0' + exponent / 100;
+	if (exponent >= 10)
+		s[i++] = '0' + (exponent / 10) % 10;
+	s[i++] = '0' + exponent % 10;
+	return i;
+}
+
+/* Numbers are written in plain decimal unless that would need a long run of
+ * zeros, a number with no fractional part is given a trailing ".0" so that
+ * it is still read back as a float and not an integer. */
+size_t float_format(char *s, double x) {
+	assert(s);
+	size_t i = 0;
+	if (isnan(x)) {
+		memcpy(s, "nan", 4);
+		return 3;
+	}
+	if (signbit(x)) {
+		s[i++] = '-';
+		x = -x;
+	}
+	if (isinf(x)) {
+		memcpy(s + i, "inf", 4);
+		return i + 3;
+	}
+	if (x == 0) {
+		memcpy(s + i, "0.0", 4);
+		return i + 3;
+	}
+	char digits[24];
+	int k = 0;
+	const int length = grisu2(x, digits, &k);
+	const int point = length + k; /* position of the decimal point */
+	if (k >= 0 && point <= 21) { /* 1234e7 -> 12340000000.0 */
+		memcpy(s + i, digits, length);
+		i += length;
+		memset(s + i, '0', k);
+		i += k;
+		memcpy(s + i, ".0", 2);
+		i += 2;
+	} else if (point > 0 && point <= 21) { /* 1234e-2 -> 12.34 */
+		memcpy(s + i, digits, point);
+		i += point;
+		s[i++] = '.';
+		memcpy(s + i, digits + point, length - point);
+		i += length - point;
+	} else if (point > -6 && point <= 0) { /* 1234e-6 -> 0.001234 */
+		s[i++] = '0';
+		s[i++] = '.';
+		memset(s + i, '0', -point);
+		i += -point;
+		memcpy(s + i, digits, length);
+		i += length;
+	} else { /* 1234e30 -> 1.234e33 */
+		s[i++] = digits[0];
+		if (length > 1) {
+			s[i++] = '.';
+			memcpy(s + i, digits + 1, length - 1);
+			i += length - 1;
+		}
+		i += exponent_format(s + i, point - 1);
+	}
+	s[i] = '\0';
+	assert(i < FLOAT_FORMAT_MAX);
+	return i;
+}
+
+/* A plain decimal number, as it is scanned, is kept as a significand of up
+ * to nineteen digits and a power of ten. */
+typedef struct {
+	uint64_t significand;
+	int exponent;
+	unsigned digits;  /* significant digits kept */
+	bool negative;
+	bool truncated;   /* non zero digits were dropped */
+} decimal_t;
+
+typedef enum {
+	DECIMAL_INTEGER,
+	DECIMAL_FLOAT,
+	DECIMAL_OTHER, /* not a plain decimal number */
+} decimal_e;
+
+static void decimal_digit(decimal_t *d, unsigned digit, bool fraction) {
+	if (!d->significand && !digit) { /* leading zero */
+		if (fraction)
+			d->exponent--;
+		return;
+	}
+	if (d->digits < 19) {
+		d->significand = (d->significand * 10) + digit;
+		d->digits++;
+		if (fraction)
+			d->exponent--;
+		return;
+	}
+	if (!fraction)
+		d->exponent++;
+	if (digit)
+		d->truncated = true;
+}
+
+static decimal_e decimal_scan(const char *s, size_t length, decimal_t *d) {
+	assert(s && d);
+	memset(d, 0, sizeof(*d));
+	size_t i = 0;
+	if (i < length && (s[i] == '-' || s[i] == '+'))
+		d->negative = s[i++] == '-';
+	const size_t first = i;
+	for (; i < length && isdigit((unsigned char)s[i]); i++)
+		decimal_digit(d, s[i] - '0', false);
+	const size_t digits = i - first;
+	if (i == length) /* an octal integer is left to 'strtol' */
+		return digits && (s[first] != '0' || digits == 1) ? DECIMAL_INTEGER : DECIMAL_OTHER;
+	size_t fraction = 0;
+	bool point = false, exponent = false;
+	if (s[i] == '.') {
+		point = true;
+		for (i++; i < length && isdigit((unsigned char)s[i]); i++, fraction++)
+			decimal_digit(d, s[i] - '0', true);
+	}
+	if (!digits && !fraction)
+		return DECIMAL_OTHER;
+	if (i < length && (s[i] == 'e' || s[i] == 'E')) {
+		size_t j = i + 1;
+		const bool negative = j < length && s[j] == '-';
+		if (j < length && (s[j] == '-' || s[j] == '+'))
+			j++;
+		const size_t start = j;
+		int e = 0;
+		for (; j < length && isdigit((unsigned char)s[j]); j++)
+			if (e < 100000)
+				e = (e * 10) + (s[j] - '0');
+		if (j > start) {
+			exponent = true;
+			d->exponent += negative ? -e : e;
+			i = j;
+		}
+	}
+	return i == length && (point || exponent) ? DECIMAL_FLOAT : DECIMAL_OTHER;
+}
+
+/* 5^q for q = -48 to 24, normalized and truncated to 128 bits (for
+ * negative q, 2^b / 5^-q rounded up then truncated) */
+#define POWER_OF_FIVE_MIN (-48)
+static const uint64_t powers_of_five[][2] = {
+	{ 0xbb127c53b17ec159uLL, 0x5560c018580d5d52uLL }, { 0xe9d71b689dde71afuLL, 0xaab8f01e6e10b4a6uLL },
+	{ 0x9226712162ab070duLL, 0xcab3961304ca70e8uLL }, { 0xb6b00d69bb55c8d1uLL, 0x3d607b97c5fd0d22uLL },
+	{ 0xe45c10c42a2b3b05uLL, 0x8cb89a7db77c506auLL }, { 0x8eb98a7a9a5b04e3uLL, 0x77f3608e92adb242uLL },
+	{ 0xb267ed1940f1c61cuLL, 0x55f038b237591ed3uLL }, { 0xdf01e85f912e37a3uLL, 0x6b6c46dec52f6688uLL },
+	{ 0x8b61313bbabce2c6uLL, 0x2323ac4b3b3da015uLL }, { 0xae397d8aa96c1b77uLL, 0xabec975e0a0d081auLL },
+	{ 0xd9c7dced53c72255uLL, 0x96e7bd358c904a21uLL }, { 0x881cea14545c7575uLL, 0x7e50d64177da2e54uLL },
+	{ 0xaa242499697392d2uLL, 0xdde50bd1d5d0b9e9uLL }, { 0xd4ad2dbfc3d07787uLL, 0x955e4ec64b44e864uLL },
+	{ 0x84ec3c97da624ab4uLL, 0xbd5af13bef0b113euLL }, { 0xa6274bbdd0fadd61uLL, 0xecb1ad8aeacdd58euLL },
+	{ 0xcfb11ead453994bauLL, 0x67de18eda5814af2uLL }, { 0x81ceb32c4b43fcf4uLL, 0x80eacf948770ced7uLL },
+	{ 0xa2425ff75e14fc31uLL, 0xa1258379a94d028duLL }, { 0xcad2f7f5359a3b3euLL, 0x096ee45813a04330uLL },
+	{ 0xfd87b5f28300ca0duLL, 0x8bca9d6e188853fcuLL }, { 0x9e74d1b791e07e48uLL, 0x775ea264cf55347euLL },
+	{ 0xc612062576589ddauLL, 0x95364afe032a819euLL }, { 0xf79687aed3eec551uLL, 0x3a83ddbd83f52205uLL },
+	{ 0x9abe14cd44753b52uLL, 0xc4926a9672793543uLL }, { 0xc16d9a0095928a27uLL, 0x75b7053c0f178294uLL },
+	{ 0xf1c90080baf72cb1uLL, 0x5324c68b12dd6339uLL }, { 0x971da05074da7beeuLL, 0xd3f6fc16ebca5e04uLL },
+	{ 0xbce5086492111aeauLL, 0x88f4bb1ca6bcf585uLL }, { 0xec1e4a7db69561a5uLL, 0x2b31e9e3d06c32e6uLL },
+	{ 0x9392ee8e921d5d07uLL, 0x3aff322e62439fd0uLL }, { 0xb877aa3236a4b449uLL, 0x09befeb9fad487c3uLL },
+	{ 0xe69594bec44de15buLL, 0x4c2ebe687989a9b4uLL }, { 0x901d7cf73ab0acd9uLL, 0x0f9d37014bf60a11uLL },
+	{ 0xb424dc35095cd80fuLL, 0x538484c19ef38c95uLL }, { 0xe12e13424bb40e13uLL, 0x2865a5f206b06fbauLL },
+	{ 0x8cbccc096f5088cbuLL, 0xf93f87b7442e45d4uLL }, { 0xafebff0bcb24aafeuLL, 0xf78f69a51539d749uLL },
+	{ 0xdbe6fecebdedd5beuLL, 0xb573440e5a884d1cuLL }, { 0x89705f4136b4a597uLL, 0x31680a88f8953031uLL },
+	{ 0xabcc77118461cefcuLL, 0xfdc20d2b36ba7c3euLL }, { 0xd6bf94d5e57a42bcuLL, 0x3d32907604691b4duLL },
+	{ 0x8637bd05af6c69b5uLL, 0xa63f9a49c2c1b110uLL }, { 0xa7c5ac471b478423uLL, 0x0fcf80dc33721d54uLL },
+	{ 0xd1b71758e219652buLL, 0xd3c36113404ea4a9uLL }, { 0x83126e978d4fdf3buLL, 0x645a1cac083126eauLL },
+	{ 0xa3d70a3d70a3d70auLL, 0x3d70a3d70a3d70a4uLL }, { 0xccccccccccccccccuLL, 0xcccccccccccccccduLL },
+	{ 0x8000000000000000uLL, 0x0000000000000000uLL }, { 0xa000000000000000uLL, 0x0000000000000000uLL },
+	{ 0xc800000000000000uLL, 0x0000000000000000uLL }, { 0xfa00000000000000uLL, 0x0000000000000000uLL },
+	{ 0x9c40000000000000uLL, 0x0000000000000000uLL }, { 0xc350000000000000uLL, 0x0000000000000000uLL },
+	{ 0xf424000000000000uLL, 0x0000000000000000uLL }, { 0x9896800000000000uLL, 0x0000000000000000uLL },
+	{ 0xbebc200000000000uLL, 0x0000000000000000uLL }, { 0xee6b280000000000uLL, 0x0000000000000000uLL },
+	{ 0x9502f90000000000uLL, 0x0000000000000000uLL }, { 0xba43b74000000000uLL, 0x0000000000000000uLL },
+	{ 0xe8d4a51000000000uLL, 0x0000000000000000uLL }, { 0x9184e72a00000000uLL, 0x0000000000000000uLL },
+	{ 0xb5e620f480000000uLL, 0x0000000000000000uLL }, { 0xe35fa931a0000000uLL, 0x0000000000000000uLL },
+	{ 0x8e1bc9bf04000000uLL, 0x0000000000000000uLL }, { 0xb1a2bc2ec5000000uLL, 0x0000000000000000uLL },
+	{ 0xde0b6b3a76400000uLL, 0x0000000000000000uLL }, { 0x8ac7230489e80000uLL, 0x0000000000000000uLL },
+	{ 0xad78ebc5ac620000uLL, 0x0000000000000000uLL }, { 0xd8d726b7177a8000uLL, 0x0000000000000000uLL },
+	{ 0x878678326eac9000uLL, 0x0000000000000000uLL }, { 0xa968163f0a57b400uLL, 0x0000000000000000uLL },
+	{ 0xd3c21bcecceda100uLL, 0x0000000000000000uLL },
+};
+
+static uint64_t multiply_128(uint64_t x, uint64_t y, uint64_t *high) {
+	const uint64_t m32 = 0xFFFFFFFFu;
+	const uint64_t a = x >> 32, b = x & m32, c = y >> 32, d = y & m32;
+	const uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	const uint64_t middle = (bd >> 32) + (ad & m32) + (bc & m32);
+	*high = ac + (ad >> 32) + (bc >> 32) + (middle >> 32);
+	return (middle << 32) | (bd & m32);
+}
+
+static int leading_zeros(uint64_t u) {
+	assert(u);
+	int n = 0;
+	for (; !(u & (1uLL << 63)); u <<= 1)
+		n++;
+	return n;
+}
+
+/* A decimal number with a significand that fits within a double and a small
+ * power of ten is converted exactly with one multiply or divide, as both
+ * operands are exact and the result correctly rounded (William D. Clinger,
+ * "How to Read Floating Point Numbers Accurately", 1990). Longer numbers
+ * are multiplied by a truncated 128-bit power of five, which gives the
+ * correctly rounded result unless it is too close to halfway between two
+ * doubles to tell (Daniel Lemire, "Number Parsing at a Gigabyte per
+ * Second", 2021). Anything else is left to 'strtod'. */
+static bool decimal_to_double(const decimal_t *d, double *x) {
+	assert(d && x);
+	if (d->truncated)
+		return false;
+#if FLT_EVAL_METHOD == 0
+	static const double exact[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+	if (d->significand <= (1uLL << 53) && d->exponent >= -22 && d->exponent <= 22) {
+		double v = (double)d->significand;
+		v = d->exponent < 0 ? v / exact[-d->exponent] : v * exact[d->exponent];
+		*x = d->negative ? -v : v;
+		return true;
+	}
+#endif
+	const int q = d->exponent;
+	const size_t index = q - POWER_OF_FIVE_MIN;
+	if (!d->significand || q < POWER_OF_FIVE_MIN || index >= sizeof(powers_of_five)/sizeof(powers_of_five[0]))
+		return false;
+	int lz = leading_zeros(d->significand);
+	const uint64_t w = d->significand << lz;
+	uint64_t upper = 0, lower = multiply_128(w, powers_of_five[index][0], &upper);
+	if ((upper & 0x1FF) == 0x1FF && lower + w < lower) { /* not enough bits, use all 128 */
+		uint64_t middle = 0;
+		const uint64_t low = multiply_128(w, powers_of_five[index][1], &middle);
+		const uint64_t sum = lower + middle;
+		if (sum < lower)
+			upper++;
+		if (sum + 1 == 0 && (upper & 0x1FF) == 0x1FF && low + w < low)
+			return false;
+		lower = sum;
+	}
+	const uint64_t upper_bit = upper >> 63;
+	uint64_t mantissa = upper >> (upper_bit + 9);
+	lz += (int)(1 ^ upper_bit);
+	if (!lower && !(upper & 0x1FF) && (mantissa & 3) == 1) /* too close to halfway */
+		return false;
+	mantissa += mantissa & 1;
+	mantissa >>= 1;
+	if (mantissa >= (1uLL << 53)) {
+		mantissa = 1uLL << 52;
+		lz--;
+	}
+	mantissa &= ~(1uLL << 52);
+	const int64_t exponent = (((152170 + 65536) * (int64_t)q) >> 16) + 1024 + 63 - lz;
+	if (exponent < 1 || exponent > 2046)
+		return false;
+	const uint64_t u = mantissa | ((uint64_t)exponent << 52) | ((uint64_t)d->negative << 63);
+	memcpy(x, &u, sizeof(*x));
+	return true;
+}
+
+/* Subnormal numbers are accepted even though 'strtod' reports them as
+ * having underflowed, they are still exact. */
+static bool string_to_double(const char *s, double *x) {
+	char *end = NULL;
+	errno = 0;
+	*x = strtod(s, &end);
+	if (*end || end == s)
+		return false;
+	return !errno || (errno == ERANGE && *x != 0 && !isinf(*x));
+}
+
+int float_parse(const char *s, size_t length, double *x) {
+	assert(s && x);
+	decimal_t d;
+	if (decimal_scan(s, length, &d) != DECIMAL_OTHER && decimal_to_double(&d, x))
+		return 0;
+	char b[CELL_MAX_STRING_LENGTH] = { 0 };
+	if (length >= sizeof(b))
+		return -1;
+	memcpy(b, s, length);
+	return string_to_double(b, x) ? 0 : -1;
+}
+
+/* The old way of telling numbers from symbols, used for anything out of
+ * the ordinary such as hexadecimal floats, "inf" and "nan" or integers
+ * that do not fit in an 'intptr_t' */
+static cell_t *atom_convert(cell_t *c, const char *token, size_t length) {
+	char s[CELL_MAX_STRING_LENGTH] = { 0 };
+	assert(length < sizeof(s));
+	memcpy(s, token, length);
+	char *end = s;
+	errno = 0;
+	c->p.integer = strtol(s, &end, 0);
+	if (!*end && !errno && end != s) {
+		c->type = INTEGER;
+		return c;
+	}
+	if (string_to_double(s, &c->p.floating)) {
+		c->type = FLOATING;
+		return c;
+	}
+	c->type = SYMBOL;
+	c->p.string = (char*)intern(token, length);
+	return c;
+}
+
+/* Tokens are classified in a single pass, plain decimal integers and most
+ * plain decimal floating point numbers are converted as they are scanned. */
+static cell_t *atom_new(cell_arena_t *a, const char *token, size_t length) {
+	assert(token && length && length < CELL_MAX_STRING_LENGTH);
+	cell_t *c = cell_alloc(a, SYMBOL);
+	decimal_t d;
+	switch (decimal_scan(token, length, &d)) {
+	case DECIMAL_INTEGER:
+		if (!d.truncated && !d.exponent) {
+			const uint64_t u = d.significand;
+			if (u <= (uint64_t)INTPTR_MAX || (d.negative && u == (uint64_t)INTPTR_MAX + 1)) {
 				c->type = INTEGER;
+				c->p.integer = d.negative ? (intptr_t)(0 - u) : (intptr_t)u;
 				return c;
 			}
-			end = s;
-			errno = 0;
-			c->p.floating = strtod(s, &end);
-			if (!*end && !errno) {
-				c->type = FLOATING;
-				return c;
-			}
-			c->p.string = duplicate(s);
-			return c;
 		}
-		default:
-			s[i] = ch;
+		return atom_convert(c, token, length);
+	case DECIMAL_FLOAT:
+		if (decimal_to_double(&d, &c->p.floating)) {
+			c->type = FLOATING;
+			return c;
 		}
+		return atom_convert(c, token, length);
+	case DECIMAL_OTHER:
+		break;
 	}
-	fprintf(stderr, "max string length %u exceeded on line %u\n", CELL_MAX_STRING_LENGTH, l->line_number);
-	cell_delete(c);
-	return NULL;
+	const size_t first = token[0] == '-' || token[0] == '+';
+	if (first < length && (isdigit((unsigned char)token[first]) || token[first] == '.'
+			|| prefixed(token + first, length - first, "inf") || prefixed(token + first, length - first, "nan")))
+		return atom_convert(c, token, length);
+	c->p.string = (char*)intern(token, length);
+	return c;
 }
 
-static cell_t *read_s_expression(lexer_t *l);
-
-static cell_t *parse_list(lexer_t *l) {
+static cell_t *parse_symbol_or_number(lexer_t *l) {
 	assert(l);
-	int ch = 0;
-again:
-	ch = get_char(l);
-	if (strchr(" \n\t", ch))
-		goto again;
-	if (ch == ')') {
-		return cell_new(NIL);
-	} else if (ch == EOF) {
-		fprintf(stderr, "unexpected EOF in list\n");
-		return NULL;
-	} else {
-		cell_t *c = cell_new(CONS);
-		unget_char(l, ch);
-		if (!(c->p.cons.car = read_s_expression(l))) {
-			cell_delete(c);
-			fprintf(stderr, "unexpected NULL in list\n");
+	if (!l->f) {
+		const char *token = l->s;
+		while (l->s != l->end && *l->s && !is_delimiter((unsigned char)*l->s))
+			l->s++;
+		const size_t length = l->s - token;
+		if (length >= CELL_MAX_STRING_LENGTH) {
+			fprintf(stderr, "max string length %u exceeded on line %u\n", CELL_MAX_STRING_LENGTH, l->line_number);
 			return NULL;
 		}
-		c->p.cons.cdr = parse_list(l);
-		return c;
+		return atom_new(l->arena, token, length);
+	}
+	char s[CELL_MAX_STRING_LENGTH] = {0};
+	for (size_t i = 0; i < CELL_MAX_STRING_LENGTH - 1; i++) {
+		const int ch = get_char(l);
+		if (is_delimiter(ch)) {
+			unget_char(l, ch);
+			return atom_new(l->arena, s, i);
+		}
+		s[i] = ch;
 	}
+	fprintf(stderr, "max string length %u exceeded on line %u\n", CELL_MAX_STRING_LENGTH, l->line_number);
+	return NULL;
 }
 
 static cell_t *read_s_expression(lexer_t *l) {
-	assert(l);
-	int ch = 0;
-again:
-	ch = get_char(l);
-	if (strchr(" \n\t", ch))
-		goto again;
-	switch (ch) {
-	case EOF:  return NULL;
-	case '(':
-		   return parse_list(l);
-	case ')':
-		   fprintf(stderr, "unexpected ')' on line %u\n", l->line_number);
-		   return NULL;
-	case '"':
-		   return parse_string(l);
-	default:
-		   unget_char(l, ch);
-		   return parse_symbol_or_number(l);
+	assert(l && !l->depth);
+	for (;;) {
+		const int ch = get_char(l);
+		if (is_space(ch))
+			continue;
+		cell_t *v = NULL;
+		switch (ch) {
+		case EOF:
+			if (l->depth)
+				fprintf(stderr, "unexpected EOF in list\n");
+			goto fail;
+		case '(':
+			l->lists = stack_reserve(l->lists, l->depth, &l->lists_size, sizeof(l->lists[0]));
+			l->lists[l->depth++] = (list_t) { .head = NULL, .tail = NULL };
+			continue;
+		case ')':
+			if (!l->depth) {
+				fprintf(stderr, "unexpected ')' on line %u\n", l->line_number);
+				return NULL;
+			}
+			l->depth--;
+			v = l->lists[l->depth].head ? l->lists[l->depth].head : nil();
+			break;
+		case '"':
+			v = parse_string(l);
+			break;
+		default:
+			unget_char(l, ch);
+			v = parse_symbol_or_number(l);
+			break;
+		}
+		if (!v) {
+			if (l->depth)
+				fprintf(stderr, "unexpected NULL in list\n");
+			goto fail;
+		}
+		if (!l->depth)
+			return v;
+		list_append(l->arena, &l->lists[l->depth - 1], v);
 	}
+fail:
+	while (l->depth)
+		cell_delete(l->lists[--l->depth].head);
 	return NULL;
 }
 
-cell_t *read_s_expression_from_file(FILE *input) {
+cell_t *read_s_expression_from_file_arena(FILE *input, cell_arena_t *arena) {
 	assert(input);
-	lexer_t *l = lexer_new(input, NULL);
+	lexer_t *l = lexer_new(input, NULL, 0, arena);
 	cell_t *c = read_s_expression(l);
 	lexer_delete(l);
 	return c;
 }
 
-cell_t *read_s_expression_from_string(const char *input) {
+cell_t *read_s_expression_from_file(FILE *input) {
+	return read_s_expression_from_file_arena(input, NULL);
+}
+
+cell_t *read_s_expression_from_buffer(const char *input, size_t length, cell_arena_t *arena) {
 	assert(input);
-	lexer_t *l = lexer_new(NULL, input);
+	lexer_t *l = lexer_new(NULL, input, length, arena);
 	cell_t *c = read_s_expression(l);
 	lexer_delete(l);
 	return c;
 }
 
-static int print_escaped_string(const char *s, FILE *output) {
-	assert(s && output);
-	int r = 1, f = 0;
-	if ((f = fputc('"', output)) < 0)
-		return f;
-	if (fflush(output) < 0) return -1;
+cell_t *read_s_expression_from_string(const char *input) {
+	assert(input);
+	return read_s_expression_from_buffer(input, strlen(input), NULL);
+}
+
+cell_t *read_s_expression_from_path(const char *path, cell_arena_t *arena) {
+	assert(path);
+	cell_t *c = NULL;
+#ifndef _WIN32
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+	void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED)
+		return NULL;
+	(void)madvise(m, st.st_size, MADV_SEQUENTIAL);
+	c = read_s_expression_from_buffer(m, st.st_size, arena);
+	munmap(m, st.st_size);
+#else
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+	long size = 0;
+	if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 0 && fseek(f, 0, SEEK_SET) == 0) {
+		char *b = allocate(size);
+		if (fread(b, 1, size, f) == (size_t)size)
+			c = read_s_expression_from_buffer(b, size, arena);
+		free(b);
+	}
+	fclose(f);
+#endif
+	return c;
+}
+
+#define EMITTER_BUFFER (64u * 1024u)
+#define FORMAT_DEPTH   (32u) /* deepest nesting of a printer or scanner format */
+#define EMITTER_NUMBER (64u) /* longest formatted number */
+
+struct emitter_t {
+	FILE *output;
+	char *buffer;
+	size_t used, size;
+	size_t written; /* bytes written in total */
+	unsigned depth;
+	bool error;
+};
+
+emitter_t *emitter_new(FILE *output) {
+	assert(output);
+	emitter_t *e = allocate(sizeof(*e));
+	e->output = output;
+	e->size   = EMITTER_BUFFER;
+	e->buffer = allocate(e->size);
+	return e;
+}
+
+int emitter_flush(emitter_t *e) {
+	assert(e);
+	if (e->used && !e->error && fwrite(e->buffer, 1, e->used, e->output) != e->used)
+		e->error = true;
+	e->used = 0;
+	return e->error ? -1 : 0;
+}
+
+long emitter_delete(emitter_t *e) {
+	if (!e)
+		return 0;
+	const long r = emitter_flush(e) < 0 ? -1 : (long)e->written;
+	free(e->buffer);
+	free(e);
+	return r;
+}
+
+static char *emit_reserve(emitter_t *e, size_t length) {
+	assert(e && length <= e->size);
+	if (e->size - e->used < length)
+		emitter_flush(e);
+	return &e->buffer[e->used];
+}
+
+static void emit_commit(emitter_t *e, size_t length) {
+	assert(e && e->used + length <= e->size);
+	e->used    += length;
+	e->written += length;
+}
+
+static void emit_raw(emitter_t *e, const char *s, size_t length) {
+	assert(e && s);
+	while (length) {
+		const size_t n = MIN(length, e->size);
+		memcpy(emit_reserve(e, n), s, n);
+		emit_commit(e, n);
+		s += n;
+		length -= n;
+	}
+}
+
+static void emit_char(emitter_t *e, char ch) {
+	*emit_reserve(e, 1) = ch;
+	emit_commit(e, 1);
+}
+
+/* Nested lists start on a new line indented by their depth */
+void emit_begin(emitter_t *e) {
+	assert(e);
+	if (e->depth) {
+		emit_char(e, '\n');
+		for (unsigned i = 0; i < e->depth; i++)
+			emit_char(e, ' ');
+	}
+	emit_char(e, '(');
+	e->depth++;
+}
+
+void emit_end(emitter_t *e) {
+	assert(e && e->depth);
+	emit_char(e, ')');
+	e->depth--;
+}
+
+void emit_nil(emitter_t *e) {
+	emit_raw(e, "() ", 3);
+}
+
+void emit_symbol(emitter_t *e, const char *s) {
+	assert(s);
+	emit_raw(e, s, strlen(s));
+	emit_char(e, ' ');
+}
+
+void emit_string(emitter_t *e, const char *s) {
+	assert(e && s);
+	emit_char(e, '"');
 	for (size_t i = 0; s[i]; i++) {
-		if (fflush(output) < 0) return -1;
 		switch (s[i]) {
-		case '\\':
-			if ((f = fputs("\\\\", output)) < 0)
-				return f;
-			r += f;
-			break;
-		case '\"':
-			if ((f = fputs("\\\"", output)) < 0)
-				return f;
-			r += f;
-			break;
-		case '\n':
-			if ((f = fputs("\\n", output)) < 0)
-				return f;
-			r += f;
-			break;
-		default:
-			if ((f = fputc(s[i], output)) < 0)
-				return f;
-			r += 1;
-			break;
+		case '\\':  emit_raw(e, "\\\\", 2); break;
+		case '"':   emit_raw(e, "\\\"", 2); break;
+		case '\n':  emit_raw(e, "\\n", 2);  break;
+		default:    emit_char(e, s[i]);     break;
 		}
 	}
-	if ((f = fputs("\" ", output)) < 0)
-		return f;
-	if (fflush(output) < 0) return -1;
-	r += f;
-	return r;
+	emit_raw(e, "\" ", 2);
 }
 
-static int indent(unsigned count, FILE *output) {
-	int r = count;
-	while (count--)
-		if (fputc(' ', output) < 0)
-			return -1;
-	return r;
+void emit_integer(emitter_t *e, intptr_t x) {
+	char *b = emit_reserve(e, EMITTER_NUMBER);
+	const int n = snprintf(b, EMITTER_NUMBER, "%"PRIdPTR" ", x);
+	if (n < 0 || n >= (int)EMITTER_NUMBER) {
+		e->error = true;
+		return;
+	}
+	emit_commit(e, n);
 }
 
-static int _write_s_expression_to_file(cell_t *cell, FILE *output, unsigned depth) {
-	assert(cell && output);
-	if (!cell)
-		fatal("unexpected NULL");
-	if (fflush(output) < 0) return -1;
+void emit_float(emitter_t *e, double x) {
+	char *b = emit_reserve(e, FLOAT_FORMAT_MAX + 1);
+	const size_t n = float_format(b, x);
+	b[n] = ' ';
+	emit_commit(e, n + 1);
+}
+
+void emit_item_integer(emitter_t *e, const char *name, intptr_t x) {
+	emit_begin(e);
+	emit_symbol(e, name);
+	emit_integer(e, x);
+	emit_end(e);
+}
+
+void emit_item_float(emitter_t *e, const char *name, double x) {
+	emit_begin(e);
+	emit_symbol(e, name);
+	emit_float(e, x);
+	emit_end(e);
+}
+
+static void emit_atom(emitter_t *e, cell_t *cell) {
 	switch (cell->type) {
-	case NIL:      return fprintf(output, "() ");
-	case INTEGER:  return fprintf(output, "%"PRIdPTR" ", cell->p.integer);
-	case FLOATING: return fprintf(output, "%.5f ", cell->p.floating);
-	case SYMBOL:   return fprintf(output, "%s ", cell->p.string);
-	case STRING:   return print_escaped_string(cell->p.string, output);
-	case CONS:
-	{
-		int r = 1, f = 0;
-		if (depth)
-			if ((f = fputc('\n', output)) < 0)
-				return f;
-		if ((f = indent(depth, output)) < 0)
-			return f;
-		r += f;
-		if ((f = fputc('(', output)) < 0)
-			return f;
-		r++;
-		for ( ; cell->type != NIL; cell = cell->p.cons.cdr, r += f)
-			if ((f = _write_s_expression_to_file(cell->p.cons.car, output, depth+1)) < 0)
-				return f;
-		if ((f = fputs(")", output)) < 0)
-			return f;
-		return r + f;
-	}
-	break;
+	case NIL:      emit_nil(e);                       break;
+	case INTEGER:  emit_integer(e, cell->p.integer);  break;
+	case FLOATING: emit_float(e, cell->p.floating);   break;
+	case SYMBOL:   emit_symbol(e, cell->p.string);    break;
+	case STRING:   emit_string(e, cell->p.string);    break;
 	default:
 		fatal("unknown type '%u'", cell->type);
 	}
-	return -1;
 }
 
-int write_s_expression_to_file(cell_t *cell, FILE *output) {
-	return _write_s_expression_to_file(cell, output, 0);
+void emit_cell(emitter_t *e, cell_t *cell) {
+	assert(e && cell);
+	cell_t **lists = NULL; /* the cell of each open list being emitted */
+	size_t depth = 0, size = 0;
+	for (;;) {
+		if (cell->type == CONS) {
+			emit_begin(e);
+			lists = stack_reserve(lists, depth, &size, sizeof(lists[0]));
+			lists[depth++] = cell;
+			cell = cell->p.cons.car;
+			continue;
+		}
+		emit_atom(e, cell);
+		for (;;) { /* on to the next element, closing any lists that have ended */
+			if (!depth) {
+				free(lists);
+				return;
+			}
+			cell_t *next = lists[depth - 1]->p.cons.cdr;
+			if (next->type == CONS) {
+				lists[depth - 1] = next;
+				cell = next->p.cons.car;
+				break;
+			}
+			emit_end(e);
+			depth--;
+		}
+	}
 }
 
-int scanner(cell_t *c, const char *fmt, ...) {
-	va_list ap;
-	va_start(ap, fmt);
-	int r = vscanner(c, fmt, ap);
-	va_end(ap);
-	return r;
+int write_s_expression_to_file(cell_t *cell, FILE *output) {
+	assert(cell && output);
+	emitter_t *e = emitter_new(output);
+	emit_cell(e, cell);
+	const long r = emitter_delete(e);
+	return r < 0 ? -1 : (int)MIN(r, INT_MAX);
 }
 
 static const char *type2name(cell_type_e t) {
@@ -483,298 +1399,420 @@ static int _expect(cell_t *c, cell_type_e t, const char *file, const char *func,
 	return 0;
 }
 
-/** @brief Scan and validate S-Expression input
- *
- * Example usage:
- * 	int alpha = 0;
- * 	char *bravo = NULL;
- * 	scanner(cell, "%x (alpha %d) (bravo %s) ("charlie" %*f)", &alpha, &bravo);
- *
- * "*" specifier means the argument is ignored.
- *
- *  n = nil
- *  c = cons
- *  l = list
- *  x = any
- *  f = float
- *  d = integer
- *  s = string
- *  S = symbol */
-static int _vscanner(cell_t *c, int i, const char *fmt, va_list ap) {
-	char f = 0;
-	assert(c);
+/* A compiled format is a flat list of items, the literals in it are
+ * already converted into cells with any symbols interned, so using a
+ * format does no parsing of its own. */
+typedef enum {
+	FORMAT_OPEN,
+	FORMAT_CLOSE,
+	FORMAT_LITERAL,
+	FORMAT_CONVERSION,
+	FORMAT_END,
+} format_op_e;
+
+typedef struct {
+	format_op_e op;
+	char conversion; /* 'f', 'd', ... */
+	bool ignore;     /* '%*f' */
+	cell_t literal;  /* a symbol, number or string */
+} format_item_t;
+
+struct format_t {
+	format_item_t *items;
+	size_t count;
+};
+
+static void format_add(format_t *f, size_t *size, format_item_t item) {
+	f->items = stack_reserve(f->items, f->count, size, sizeof(f->items[0]));
+	f->items[f->count++] = item;
+}
+
+format_t *format_compile(const char *fmt) {
 	assert(fmt);
-	assert(type(c) == CONS);
-	while ((f = fmt[i])) {
-		if (isspace(f)) {
+	format_t *f = allocate(sizeof(*f));
+	size_t size = 0, depth = 0;
+	for (size_t i = 0; ; ) {
+		const char ch = fmt[i];
+		format_item_t item = { .op = FORMAT_LITERAL };
+		if (isspace(ch)) {
 			i++;
 			continue;
 		}
-		if (')' == f) { // ??
-			if (expect(c, NIL))
-				return i;
-			else
-				return -1;
+		if (!ch || (ch == ')' && !depth)) { /* the format is an implicit list */
+			item.op = FORMAT_END;
+			format_add(f, &size, item);
+			return f;
 		}
-		if (!expect(c, CONS))
-			return -1;
-		if ('%' == fmt[i]) {
-			bool ignore = false;
-			if ('*' == fmt[i + 1]) {
+		if (ch == '(') {
+			if (++depth > FORMAT_DEPTH)
+				fatal("format nested too deeply: %s", fmt);
+			item.op = FORMAT_OPEN;
+			i++;
+		} else if (ch == ')') {
+			depth--;
+			item.op = FORMAT_CLOSE;
+			i++;
+		} else if (ch == '%') {
+			item.op = FORMAT_CONVERSION;
+			if (fmt[++i] == '*') {
+				item.ignore = true;
 				i++;
-				ignore = true;
 			}
+			item.conversion = fmt[i];
+			if (!item.conversion || !strchr("lcxfdusSnv", item.conversion))
+				fatal("invalid format specifier %u/%c at %zu in: %s", fmt[i], fmt[i], i, fmt);
 			i++;
+		} else if (ch == '"') { /* string literal */
+			lexer_t *l = lexer_new(NULL, fmt + i + 1, strlen(fmt + i + 1), NULL);
+			cell_t *c = parse_string(l);
+			if (!c)
+				fatal("invalid string literal at %zu in: %s", i, fmt);
+			item.literal = *c;
+			free(c);
+			i = l->s - fmt;
+			lexer_delete(l);
+		} else { /* symbol or number */
+			const size_t start = i;
+			while (fmt[i] && !strchr("()*%\" \t\n\r\v", fmt[i]))
+				i++;
+			if (i == start || i - start >= CELL_MAX_STRING_LENGTH)
+				fatal("invalid literal at %zu in: %s", start, fmt);
+			cell_t *c = atom_new(NULL, fmt + start, i - start);
+			item.literal = *c;
+			free(c);
+		}
+		format_add(f, &size, item);
+	}
+}
 
-			cell_t *ca = car(c);
-			switch ((f = fmt[i])) {
-			case 'l':
-			case 'c':
-			{
-				bool list = f == 'l';
-				if (!expect(list ? c : ca, CONS))
-					return -1;
-				cell_t **v = va_arg(ap, cell_t **);
-				if (ignore)
-					break;
+void format_delete(format_t *f) {
+	if (!f)
+		return;
+	for (size_t i = 0; i < f->count; i++)
+		if (f->items[i].op == FORMAT_LITERAL && f->items[i].literal.type == STRING)
+			free(f->items[i].literal.p.string);
+	free(f->items);
+	free(f);
+}
+
+static bool literal_match(const format_item_t *item, cell_t *c) {
+	cell_t *literal = (cell_t*)&item->literal;
+	return expect(c, literal->type) && cell_eq(literal, c);
+}
+
+/* Floats to the end of the list 'c' are stored in 'array' */
+static int floats_scan(cell_t *c, va_list ap, bool ignore) {
+	double *array = va_arg(ap, double *);
+	const size_t capacity = va_arg(ap, size_t);
+	size_t *count = va_arg(ap, size_t *);
+	size_t n = 0;
+	for (; type(c) == CONS; c = cdr(c), n++) {
+		if (!expect(car(c), FLOATING))
+			return -1;
+		if (n >= capacity) {
+			fprintf(stderr, "expected at most %zu floats\n", capacity);
+			return -1;
+		}
+		if (!ignore)
+			array[n] = FLT(car(c));
+	}
+	if (!ignore)
+		*count = n;
+	return 0;
+}
+
+int vformat_scan(const format_t *f, cell_t *c, va_list ap) {
+	assert(f && c);
+	assert(type(c) == CONS);
+	cell_t *parents[FORMAT_DEPTH]; /* the lists that nested formats are in */
+	size_t depth = 0;
+	va_list ap2;
+	va_copy(ap2, ap);
+	int r = -1;
+	for (size_t i = 0; ; i++) {
+		const format_item_t *item = &f->items[i];
+		if (item->op == FORMAT_END) {
+			r = 0;
+			goto done;
+		}
+		if (item->op == FORMAT_CLOSE) {
+			if (!expect(c, NIL))
+				goto done;
+			goto close;
+		}
+		if (!expect(c, CONS))
+			goto done;
+		cell_t *ca = car(c);
+		if (item->op == FORMAT_OPEN) {
+			if (!expect(ca, CONS))
+				goto done;
+			parents[depth++] = c;
+			c = ca;
+			continue;
+		}
+		if (item->op == FORMAT_LITERAL) {
+			if (!literal_match(item, ca))
+				goto done;
+			c = cdr(c);
+			continue;
+		}
+		const bool ignore = item->ignore;
+		switch (item->conversion) {
+		case 'l':
+		case 'c':
+		{
+			const bool list = item->conversion == 'l';
+			if (!expect(list ? c : ca, CONS))
+				goto done;
+			cell_t **v = va_arg(ap2, cell_t **);
+			if (!ignore)
 				*v = list ? c : ca;
-				if (list)
-					return i;
-				break;
-			}
-			case 'x':
-			{
-				cell_t **v = va_arg(ap, cell_t **);
-				if (ignore)
-					break;
+			break;
+		}
+		case 'v':
+			if (floats_scan(c, ap2, ignore) < 0)
+				goto done;
+			break;
+		case 'x':
+		{
+			cell_t **v = va_arg(ap2, cell_t **);
+			if (!ignore)
 				*v = ca;
-				break;
-			}
-			case 'f':
-			{
-				if (!expect(ca, FLOATING))
-					return -1;
-				double *d = va_arg(ap, double *);
-				if (ignore)
-					break;
+			break;
+		}
+		case 'f':
+		{
+			if (!expect(ca, FLOATING))
+				goto done;
+			double *d = va_arg(ap2, double *);
+			if (!ignore)
 				*d = FLT(ca);
-				break;
-			}
-			case 'u':
-			case 'd':
-			{
-				if (!expect(ca, INTEGER))
-					return -1;
-				intptr_t *dp = va_arg(ap, intptr_t *);
-				if (ignore)
-					break;
-				intptr_t d = INT(ca);
+			break;
+		}
+		case 'u':
+		case 'd':
+		{
+			if (!expect(ca, INTEGER))
+				goto done;
+			intptr_t *dp = va_arg(ap2, intptr_t *);
+			const intptr_t d = INT(ca);
+			if (!ignore)
 				*dp = d;
-				if (f == 'u' && d < 0) {
-					fprintf(stderr, "expected unsigned number (got %"PRIdPTR")\n", d);
-					return -1;
-				}
-				break;
+			if (item->conversion == 'u' && d < 0) {
+				fprintf(stderr, "expected unsigned number (got %"PRIdPTR")\n", d);
+				goto done;
 			}
-			case 's':
-			{
-				if (!expect(ca, STRING))
-					return -1;
-				char **s = va_arg(ap, char **);
-				if (ignore)
-					break;
-				*s = STR(ca);
-				break;
+			break;
+		}
+		case 's':
+		case 'S':
+		{
+			if (!expect(ca, item->conversion == 's' ? STRING : SYMBOL))
+				goto done;
+			char **s = va_arg(ap2, char **);
+			if (!ignore)
+				*s = ca->p.string;
+			break;
+		}
+		case 'n':
+			if (!expect(ca, NIL))
+				goto done;
+			break;
+		default:
+			fatal("invalid format specifier %u/%c", item->conversion, item->conversion);
+		}
+		if (item->conversion != 'l' && item->conversion != 'v') {
+			c = cdr(c);
+			continue;
+		}
+		/* a list consumes the rest of the enclosing list */
+		if (f->items[i + 1].op == FORMAT_CLOSE)
+			i++;
+close: /* carry on after the nested list that has just ended */
+		if (!depth) {
+			r = 0;
+			goto done;
+		}
+		c = cdr(parents[--depth]);
+	}
+done:
+	va_end(ap2);
+	return r;
+}
+
+int format_scan(const format_t *f, cell_t *c, ...) {
+	va_list ap;
+	va_start(ap, c);
+	const int r = vformat_scan(f, c, ap);
+	va_end(ap);
+	return r;
+}
+
+cell_t *vformat_print(cell_arena_t *a, const format_t *f, va_list ap) {
+	assert(f);
+	list_t lists[FORMAT_DEPTH + 1] = { { NULL, NULL } }; /* the format is an implicit list */
+	size_t depth = 1;
+	va_list ap2;
+	va_copy(ap2, ap);
+	for (size_t i = 0; depth; i++) {
+		const format_item_t *item = &f->items[i];
+		cell_t *v = NULL;
+		switch (item->op) {
+		case FORMAT_OPEN:
+			lists[depth++] = (list_t) { .head = NULL, .tail = NULL };
+			continue;
+		case FORMAT_CLOSE:
+		case FORMAT_END:
+			if (item->op == FORMAT_END)
+				i--; /* close any lists left open */
+			depth--;
+			v = lists[depth].head ? lists[depth].head : nil();
+			if (!depth) {
+				va_end(ap2);
+				return v;
 			}
-			case 'S':
+			break;
+		case FORMAT_LITERAL:
+			v = item->literal.type == STRING ?
+				mkstring_in(a, STRING, item->literal.p.string) :
+				cell_alloc(a, item->literal.type);
+			if (item->literal.type != STRING)
+				v->p = item->literal.p;
+			break;
+		case FORMAT_CONVERSION:
+			switch (item->conversion) {
+			case 'x': v = va_arg(ap2, cell_t *);                        break;
+			case 'f': v = mkfloat_in(a, va_arg(ap2, double));           break;
+			case 'u':
+			case 'd': v = mkint_in(a, va_arg(ap2, intptr_t));           break;
+			case 's': v = mkstring_in(a, STRING, va_arg(ap2, char*));   break;
+			case 'S': v = mkstring_in(a, SYMBOL, va_arg(ap2, char*));   break;
+			case 'v':
 			{
-				if (!expect(ca, SYMBOL))
-					return -1;
-				char **s = va_arg(ap, char **);
-				if (ignore)
-					break;
-				*s = STR(c);
-				break;
+				const double *array = va_arg(ap2, const double *);
+				const size_t count = va_arg(ap2, size_t);
+				for (size_t j = 0; j < count; j++)
+					list_append(a, &lists[depth - 1], mkfloat_in(a, array[j]));
+				continue;
 			}
-			case 'n':
+			default:
+				fatal("invalid format specifier %u/%c", item->conversion, item->conversion);
+			}
+			break;
+		}
+		list_append(a, &lists[depth - 1], v);
+	}
+	va_end(ap2);
+	return nil();
+}
+
+cell_t *format_print(cell_arena_t *a, const format_t *f, ...) {
+	va_list ap;
+	va_start(ap, f);
+	cell_t *c = vformat_print(a, f, ap);
+	va_end(ap);
+	return c;
+}
+
+void vformat_emit(emitter_t *e, const format_t *f, va_list ap) {
+	assert(e && f);
+	size_t depth = 1;
+	va_list ap2;
+	va_copy(ap2, ap);
+	emit_begin(e);
+	for (size_t i = 0; f->items[i].op != FORMAT_END; i++) {
+		const format_item_t *item = &f->items[i];
+		switch (item->op) {
+		case FORMAT_OPEN:
+			emit_begin(e);
+			depth++;
+			break;
+		case FORMAT_CLOSE:
+			emit_end(e);
+			depth--;
+			break;
+		case FORMAT_LITERAL:
+			emit_atom(e, (cell_t*)&item->literal);
+			break;
+		case FORMAT_CONVERSION:
+			switch (item->conversion) {
+			case 'x': emit_cell(e, va_arg(ap2, cell_t *));       break;
+			case 'f': emit_float(e, va_arg(ap2, double));        break;
+			case 'u':
+			case 'd': emit_integer(e, va_arg(ap2, intptr_t));    break;
+			case 's': emit_string(e, va_arg(ap2, const char *)); break;
+			case 'S': emit_symbol(e, va_arg(ap2, const char *)); break;
+			case 'v':
 			{
-				if (!expect(ca, NIL))
-					return -1;
+				const double *array = va_arg(ap2, const double *);
+				const size_t count = va_arg(ap2, size_t);
+				for (size_t j = 0; j < count; j++)
+					emit_float(e, array[j]);
 				break;
 			}
-			case '\0':
 			default:
-				fatal("invalid format specifier %u/%c", f, f);
-			}
-			i++;
-		} else if ('(' == f) {
-			if (!expect(car(c), CONS))
-				return -1;
-			//va_list ap2;
-			//va_copy(ap2, ap);
-			//int r = _vscanner(car(c), ++i, fmt, ap2);
-			//va_end(ap2);
-			int r = _vscanner(car(c), ++i, fmt, ap);
-			if (r < 0)
-				return r;
-			i += (r-i+1);
-		} else {
-			char s[CELL_MAX_STRING_LENGTH] = { 0 };
-			if (f == '"') { /* string literal */
-				size_t j = 0;
-				if (!expect(car(c), STRING))
-					return -1;
-				while (strchr("\"", fmt[i])) {
-					if (fmt[i] == '\\')
-						i++;
-					s[j++] = fmt[i++];
-				}
-				if (strcmp(STR(car(c)), s))
-					return -1;
-			} else { /* symbol literal */
-				size_t j = 0;
-				if (!expect(car(c), SYMBOL))
-					return -1;
-				while (!strchr("()*%\" \t\n\r\v", fmt[i]))
-					s[j++] = fmt[i++];
-				if (strcmp(SYM(car(c)), s))
-					return -1;
+				fatal("invalid format specifier %u/%c", item->conversion, item->conversion);
 			}
+			break;
+		case FORMAT_END:
+			break;
 		}
-		c = cdr(c);
 	}
-	return i;
+	for (; depth; depth--)
+		emit_end(e);
+	va_end(ap2);
+}
+
+void format_emit(emitter_t *e, const format_t *f, ...) {
+	va_list ap;
+	va_start(ap, f);
+	vformat_emit(e, f, ap);
+	va_end(ap);
 }
 
+/* The format strings are compiled on every call, code that scans or prints
+ * the same format over and over should compile it once instead */
 int vscanner(cell_t *c, const char *fmt, va_list ap) {
 	assert(c);
 	assert(fmt);
-	va_list ap2;
-	va_copy(ap2, ap);
-	const int r = _vscanner(c, 0, fmt, ap2);
-	va_end(ap2);
+	format_t *f = format_compile(fmt);
+	const int r = vformat_scan(f, c, ap);
+	format_delete(f);
 	return r;
 }
 
-cell_t *printer(const char *fmt, ...) {
+int scanner(cell_t *c, const char *fmt, ...) {
 	va_list ap;
 	va_start(ap, fmt);
-	cell_t *c = vprinter(fmt, ap);
+	int r = vscanner(c, fmt, ap);
 	va_end(ap);
-	return c;
+	return r;
 }
 
-static cell_t *_vprinter(int *i, const char *fmt, va_list ap) {
-	assert(i);
+cell_t *vprinter_arena(cell_arena_t *arena, const char *fmt, va_list ap) {
 	assert(fmt);
-	cell_t *head = cell_new(CONS);
-	cell_t *c = head, *prev = NULL;
-	for(char f = 0; (f = fmt[*i]); ) {
-		if (isspace(f)) {
-			(*i)++;
-			continue;
-		}
+	format_t *f = format_compile(fmt);
+	cell_t *r = vformat_print(arena, f, ap);
+	format_delete(f);
+	return r;
+}
 
-		if (')' == f || !f) {
-			(*i)++;
-			goto end;
-		}
+cell_t *vprinter(const char *fmt, va_list ap) {
+	return vprinter_arena(NULL, fmt, ap);
+}
 
-		if ('%' == (f = fmt[*i])) {
-			cell_t *v = NULL, *n = NULL;
-			(*i)++;
-			f = fmt[*i];
-			switch (f) {
-			case 'x':
-				v = va_arg(ap, cell_t *);
-				n = cell_new(CONS);
-				break;
-			case 'f':
-			{
-				double d = va_arg(ap, double);
-				v = mkfloat(d);
-				n = cell_new(CONS);
-				break;
-			}
-			case 'd':
-			{
-				intptr_t d = va_arg(ap, intptr_t);
-				v = mkint(d);
-				n = cell_new(CONS);
-				break;
-			}
-			case 's':
-			{
-				char *s = va_arg(ap, char*);
-				v = mkstr(s);
-				n = cell_new(CONS);
-				break;
-			}
-			case 'S':
-			{
-				char *s = va_arg(ap, char*);
-				v = mksym(s);
-				n = cell_new(CONS);
-				break;
-			}
-			default:
-				fatal("invalid format specifier %u/%c at %d", f, f, *i);
-				cell_delete(c);
-				return NULL;
-			}
-			c->p.cons.car = v;
-			c->p.cons.cdr = n;
-			prev = c;
-			c = n;
-			(*i)++;
-		} else if (f == '(') {
-			(*i)++;
-			//va_list ap2;
-			//va_copy(ap2, ap);
-			//cell_t *v = _vprinter(i, fmt, ap2);
-			//va_end(ap2);
-			cell_t *v = _vprinter(i, fmt, ap);
-			cell_t *n = cell_new(CONS);
-			c->p.cons.car = v;
-			c->p.cons.cdr = n;
-			prev = c;
-			c = n;
-		} else {
-			lexer_t *l = lexer_new(NULL, fmt+*i);
-			cell_t *n = NULL, *v = NULL;
-			if (f == '"') { /* string literal */
-				l->s++;
-				v = parse_string(l);
-			} else {
-				v = parse_symbol_or_number(l);
-			}
-			/* TODO: Error handling 
-			if (!v)
-				goto end; */
-			n = cell_new(CONS);
-			c->p.cons.car = v;
-			c->p.cons.cdr = n;
-			prev = c;
-			c = n;
-			int inc = l->s - (fmt+*i);
-			*i += inc;
-			lexer_delete(l);
-		}
-	}
-end:
-	if (!prev)
-		return nil();
-	if (!(c->p.cons.car))
-		prev->p.cons.cdr = nil();
-	c->p.cons.cdr = nil();
-	return head;
+cell_t *printer(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	cell_t *c = vprinter(fmt, ap);
+	va_end(ap);
+	return c;
 }
 
-cell_t *vprinter(const char *fmt, va_list ap) {
-	int i = 0;
-	va_list ap2;
-	va_copy(ap2, ap);
-	cell_t *r = _vprinter(&i, fmt, ap2);
-	va_end(ap2);
-	return r;
+cell_t *printer_arena(cell_arena_t *arena, const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	cell_t *c = vprinter_arena(arena, fmt, ap);
+	va_end(ap);
+	return c;
 }
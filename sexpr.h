@@ -50,6 +50,25 @@ typedef struct cell_t {
 #define CDAR(CELL) (cdr(car(CELL)))
 #define CDDR(CELL) (cdr(cdr(CELL)))
 
+/** A cell arena holds every cell, and string, allocated from it in a few
+ * large chunks which are all released at once by 'cell_arena_delete'. A
+ * tree built in an arena must only contain cells from that same arena,
+ * calling 'cell_delete' on one of its cells does nothing. */
+struct cell_arena_t;
+typedef struct cell_arena_t cell_arena_t;
+
+cell_arena_t *cell_arena_new(void);
+void cell_arena_delete(cell_arena_t *a);
+size_t cell_arena_size(const cell_arena_t *a);
+
+/** Symbols are interned, there is only ever one copy of a symbol's name so
+ * two symbols are the same if their names are at the same address. Names
+ * are kept for the life of the program. 'intern_find' returns NULL for a
+ * name that has never been interned, which no symbol can have. Interning
+ * is not thread safe. */
+const char *intern(const char *s, size_t length);
+const char *intern_find(const char *s, size_t length);
+
 cell_type_e type(cell_t *cell);
 cell_t *car(cell_t *cons);
 cell_t *cdr(cell_t *cons);
@@ -57,9 +76,42 @@ void setcar(cell_t *cons, cell_t *car);
 void setcdr(cell_t *cons, cell_t *cdr);
 cell_t *cons(cell_t *car, cell_t *cdr);
 void cell_delete(cell_t *cell);
+/* The 'arena' arguments are optional, if NULL cells are allocated singly */
 cell_t *read_s_expression_from_file(FILE *input);
+cell_t *read_s_expression_from_file_arena(FILE *input, cell_arena_t *arena);
 cell_t *read_s_expression_from_string(const char *input);
+cell_t *read_s_expression_from_buffer(const char *input, size_t length, cell_arena_t *arena);
+cell_t *read_s_expression_from_path(const char *path, cell_arena_t *arena);
 int write_s_expression_to_file(cell_t *cell, FILE *output);
+
+/** Floats are written with the fewest digits that read back as exactly the
+ * same double, 'float_format' needs a buffer of FLOAT_FORMAT_MAX bytes and
+ * returns the length of the string. 'float_parse' reads the 'length'
+ * characters of 's' as a float, returning negative on failure. */
+#define FLOAT_FORMAT_MAX (32u)
+size_t float_format(char *s, double x);
+int float_parse(const char *s, size_t length, double *x);
+
+/** An emitter writes S-Expressions straight to a stream, through a large
+ * buffer, without first building a tree of cells. Lists are opened and
+ * closed with 'emit_begin' and 'emit_end', errors are sticky and are
+ * reported when the emitter is flushed or deleted. */
+struct emitter_t;
+typedef struct emitter_t emitter_t;
+
+emitter_t *emitter_new(FILE *output);
+int emitter_flush(emitter_t *e);
+long emitter_delete(emitter_t *e); /* returns bytes written or negative on failure */
+void emit_begin(emitter_t *e);
+void emit_end(emitter_t *e);
+void emit_nil(emitter_t *e);
+void emit_symbol(emitter_t *e, const char *s);
+void emit_string(emitter_t *e, const char *s);
+void emit_integer(emitter_t *e, intptr_t x);
+void emit_float(emitter_t *e, double x);
+void emit_item_integer(emitter_t *e, const char *name, intptr_t x); /* (name x) */
+void emit_item_float(emitter_t *e, const char *name, double x);
+void emit_cell(emitter_t *e, cell_t *cell);
 cell_t *cons(cell_t *car, cell_t *cdr);
 cell_t *nil(void);
 size_t cell_length(cell_t *c);
@@ -74,5 +126,27 @@ int scanner(cell_t *c, const char *fmt, ...);
 int vscanner(cell_t *c, const char *fmt, va_list ap);
 cell_t *printer(const char *fmt, ...);
 cell_t *vprinter(const char *fmt, va_list ap);
+cell_t *printer_arena(cell_arena_t *arena, const char *fmt, ...);
+cell_t *vprinter_arena(cell_arena_t *arena, const char *fmt, va_list ap);
+
+/** A format, as used by 'scanner' and 'printer', can be compiled once with
+ * 'format_compile' and then used any number of times without parsing the
+ * format string again. A compiled format can scan a tree, print one or emit
+ * it straight to a stream. Besides the conversions 'scanner' and 'printer'
+ * take, '%v' is a vector of floats running to the end of its list; printing
+ * takes a 'const double *' and a 'size_t' count, scanning takes a 'double *',
+ * a 'size_t' capacity and a 'size_t *' that the count is stored in. Scanning
+ * returns negative on failure. */
+struct format_t;
+typedef struct format_t format_t;
+
+format_t *format_compile(const char *fmt);
+void format_delete(format_t *f);
+int format_scan(const format_t *f, cell_t *c, ...);
+int vformat_scan(const format_t *f, cell_t *c, va_list ap);
+cell_t *format_print(cell_arena_t *arena, const format_t *f, ...);
+cell_t *vformat_print(cell_arena_t *arena, const format_t *f, va_list ap);
+void format_emit(emitter_t *e, const format_t *f, ...);
+void vformat_emit(emitter_t *e, const format_t *f, va_list ap);
 
 #endif
@@ -0,0 +1,379 @@
+/** @file       snapshot.c
+ *  @brief      A versioned binary file of sections that can be mapped in
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com
+ *
+ * A snapshot is made entirely of 64-bit words in native byte order:
+ *
+ * 	header:  magic, version, byte order mark, sections, size, checksum
+ * 	table:   type, offset, count, element size; for each section
+ * 	payload: the sections, each a packed array of fixed size elements
+ *
+ * The checksum covers everything after the header. As every field is a
+ * 64-bit word a section can be used in place once the file is mapped in,
+ * there is no parsing to do. The hashes a snapshot holds, its checksum
+ * included, are of native words, so a snapshot written on a machine of
+ * the other byte order is refused rather than converted.
+ *
+ * Snapshots can be written on a background thread; the sections are copied
+ * into an image by the caller, which is quick, and the checksumming and
+ * the slow part, writing and syncing the file, are left to the thread. */
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "snapshot.h"
+#include "util.h"
+#include "vars.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define SNAPSHOT_VERSION (2u)
+#define SNAPSHOT_ORDER   (0x0102030405060708uLL)
+
+typedef struct {
+	char magic[8];
+	uint64_t version;
+	uint64_t order;
+	uint64_t sections;
+	uint64_t size;
+	uint64_t checksum;
+} header_t;
+
+typedef struct {
+	uint64_t type, offset, count, element_size;
+} section_t;
+
+typedef struct {
+	const void *data;
+	section_t section;
+} pending_t;
+
+struct snapshot_t {
+	bool write;
+	/* writing */
+	pending_t *pending;
+	size_t count, max;
+	/* reading */
+	uint8_t *base;
+	size_t size;
+	bool mapped;
+};
+
+static const char magic[8] = { 'G', 'L', 'A', 'D', 'S', 'N', 'A', 'P' };
+
+snapshot_t *snapshot_new(void) {
+	snapshot_t *s = allocate(sizeof(*s));
+	s->write = true;
+	return s;
+}
+
+int snapshot_section_add(snapshot_t *s, uint64_t type, const void *data, size_t count, size_t element_size) {
+	assert(s && s->write);
+	if (!element_size || element_size % sizeof(uint64_t) || (count && !data)) {
+		warning("snapshot: invalid section %llu", (unsigned long long)type);
+		return -1;
+	}
+	if (s->count == s->max) {
+		s->max = s->max ? s->max * 2 : 16;
+		pending_t *n = realloc(s->pending, sizeof(s->pending[0]) * s->max);
+		if (!n)
+			fatal("allocation failed of size %zu\n", sizeof(s->pending[0]) * s->max);
+		s->pending = n;
+	}
+	s->pending[s->count++] = (pending_t) {
+		.data = data,
+		.section = { .type = type, .count = count, .element_size = element_size },
+	};
+	return 0;
+}
+
+/* The file is assembled in memory so it can be checksummed and written with
+ * a single call, the data of each section is copied into the image so it
+ * need not outlive this call. */
+static uint8_t *snapshot_image(snapshot_t *s, size_t *bytes) {
+	assert(s && s->write && bytes);
+	size_t size = sizeof(header_t) + sizeof(section_t) * s->count;
+	for (size_t i = 0; i < s->count; i++) {
+		section_t *t = &s->pending[i].section;
+		t->offset = size;
+		size += t->count * t->element_size;
+	}
+	uint8_t *image = allocate(size);
+	header_t *h = (header_t*)image;
+	section_t *table = (section_t*)(image + sizeof(*h));
+	memcpy(h->magic, magic, sizeof(magic));
+	h->version  = SNAPSHOT_VERSION;
+	h->order    = SNAPSHOT_ORDER;
+	h->sections = s->count;
+	h->size     = size;
+	for (size_t i = 0; i < s->count; i++) {
+		const section_t *t = &s->pending[i].section;
+		table[i] = *t;
+		if (t->count)
+			memcpy(image + t->offset, s->pending[i].data, t->count * t->element_size);
+	}
+	*bytes = size;
+	return image;
+}
+
+/* The image is checksummed and written to a temporary file, which is synced
+ * to disk and then renamed over 'file', so a partially written file is never
+ * left under 'file' even if the machine goes down. */
+static int image_write(uint8_t *image, size_t size, const char *file) {
+	assert(image && file);
+	header_t *h = (header_t*)image;
+	h->checksum = hash64(image + sizeof(*h), size - sizeof(*h), 0);
+
+	const size_t length = strlen(file);
+	char *temporary = allocate(length + sizeof(".tmp"));
+	memcpy(temporary, file, length);
+	memcpy(temporary + length, ".tmp", sizeof(".tmp"));
+	int r = -1;
+	FILE *out = fopen(temporary, "wb");
+	if (!out) {
+		warning("snapshot: could not open '%s' for writing", temporary);
+		goto done;
+	}
+	bool written = fwrite(image, 1, size, out) == size;
+#ifndef _WIN32
+	written = written && fflush(out) == 0 && fsync(fileno(out)) == 0;
+#endif
+	if (fclose(out) < 0 || !written) {
+		warning("snapshot: failed to write '%s'", temporary);
+		remove(temporary);
+		goto done;
+	}
+#ifdef _WIN32
+	remove(file); /* rename does not replace an existing file */
+#endif
+	if (rename(temporary, file) < 0) {
+		warning("snapshot: could not rename '%s' to '%s'", temporary, file);
+		remove(temporary);
+		goto done;
+	}
+	r = 0;
+done:
+	free(temporary);
+	return r;
+}
+
+int snapshot_write(snapshot_t *s, const char *file) {
+	assert(s && s->write && file);
+	size_t size = 0;
+	uint8_t *image = snapshot_image(s, &size);
+	const int r = image_write(image, size, file);
+	free(image);
+	return r;
+}
+
+/* Only one snapshot is written in the background at a time, the thread
+ * owns the image and the file name until it is joined. */
+static struct {
+	bool running;     /* a thread has been started and not yet joined */
+	bool finished;    /* set by the thread once it is done */
+	int result;
+	uint8_t *image;
+	size_t size;
+	char *file;
+#ifndef _WIN32
+	pid_t pid;        /* of the process that started the thread */
+	pthread_t thread;
+#endif
+} background;
+
+#ifndef _WIN32
+static void *background_thread(void *param) {
+	UNUSED(param);
+	background.result = image_write(background.image, background.size, background.file);
+	__atomic_store_n(&background.finished, true, __ATOMIC_RELEASE);
+	return NULL;
+}
+#endif
+
+bool snapshot_busy(void) {
+	return background.running && !__atomic_load_n(&background.finished, __ATOMIC_ACQUIRE);
+}
+
+int snapshot_wait(void) {
+	if (!background.running)
+		return 0;
+#ifndef _WIN32
+	if (background.pid != getpid()) /* a forked child has no such thread */
+		return 0;
+	pthread_join(background.thread, NULL);
+#endif
+	background.running = false;
+	free(background.image);
+	free(background.file);
+	background.image = NULL;
+	background.file = NULL;
+	return background.result;
+}
+
+int snapshot_write_background(snapshot_t *s, const char *file) {
+	assert(s && s->write && file);
+	if (snapshot_busy())
+		return -1;
+	(void)snapshot_wait(); /* any failure has already been reported */
+	background.image = snapshot_image(s, &background.size);
+	background.file = duplicate(file);
+	background.finished = false;
+	background.result = -1;
+#ifndef _WIN32
+	background.pid = getpid();
+	if (!pthread_create(&background.thread, NULL, background_thread, NULL)) {
+		background.running = true;
+		return 0;
+	}
+	warning("snapshot: could not start a thread, writing '%s' in the foreground", file);
+#endif
+	background.result = image_write(background.image, background.size, background.file);
+	background.running = true;
+	background.finished = true;
+	return 0;
+}
+
+static int snapshot_read(snapshot_t *s, const char *file) {
+	assert(s && file);
+#ifndef _WIN32
+	const int fd = open(file, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(header_t)) {
+		close(fd);
+		return -1;
+	}
+	void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED)
+		return -1;
+	s->base   = m;
+	s->size   = st.st_size;
+	s->mapped = true;
+	return 0;
+#else
+	FILE *in = fopen(file, "rb");
+	if (!in)
+		return -1;
+	int r = -1;
+	long size = 0;
+	if (fseek(in, 0, SEEK_END) < 0 || (size = ftell(in)) < (long)sizeof(header_t) || fseek(in, 0, SEEK_SET) < 0)
+		goto done;
+	if (size % sizeof(uint64_t)) {
+		warning("snapshot: truncated");
+		goto done;
+	}
+	s->size = size;
+	s->base = allocate(s->size);
+	if (fread(s->base, 1, s->size, in) != s->size)
+		goto done;
+	r = 0;
+done:
+	fclose(in);
+	return r;
+#endif
+}
+
+static int snapshot_validate(const snapshot_t *s) {
+	assert(s && s->base);
+	const header_t *h = (const header_t*)s->base;
+	if (memcmp(h->magic, magic, sizeof(magic))) {
+		warning("snapshot: not a snapshot");
+		return -1;
+	}
+	if (h->order != SNAPSHOT_ORDER) {
+		warning("snapshot: written on a machine of a different byte order");
+		return -1;
+	}
+	if (h->version != SNAPSHOT_VERSION) {
+		warning("snapshot: unsupported version %llu, expected %u", (unsigned long long)h->version, SNAPSHOT_VERSION);
+		return -1;
+	}
+	if (h->size != s->size || s->size % sizeof(uint64_t)) {
+		warning("snapshot: truncated");
+		return -1;
+	}
+	if (h->sections > (s->size - sizeof(*h)) / sizeof(section_t)) {
+		warning("snapshot: invalid section table");
+		return -1;
+	}
+	const size_t start = sizeof(*h) + h->sections * sizeof(section_t);
+	const section_t *table = (const section_t*)(s->base + sizeof(*h));
+	for (size_t i = 0; i < h->sections; i++) {
+		const section_t *t = &table[i];
+		if (t->offset < start || t->offset > s->size || t->offset % sizeof(uint64_t)
+			|| !t->element_size || t->element_size % sizeof(uint64_t)
+			|| t->count > (s->size - t->offset) / t->element_size) {
+			warning("snapshot: invalid section %zu", i);
+			return -1;
+		}
+	}
+	if (hash64(s->base + sizeof(*h), s->size - sizeof(*h), 0) != h->checksum) {
+		warning("snapshot: checksum mismatch");
+		return -1;
+	}
+	return 0;
+}
+
+snapshot_t *snapshot_open(const char *file) {
+	assert(file);
+	snapshot_t *s = allocate(sizeof(*s));
+	if (snapshot_read(s, file) < 0) {
+		debug("snapshot: could not read '%s'", file);
+		goto fail;
+	}
+	if (snapshot_validate(s) < 0)
+		goto fail;
+	return s;
+fail:
+	snapshot_delete(s);
+	return NULL;
+}
+
+const void *snapshot_section(const snapshot_t *s, uint64_t type, size_t element_size, size_t *count) {
+	assert(s && !s->write && count);
+	const header_t *h = (const header_t*)s->base;
+	const section_t *table = (const section_t*)(s->base + sizeof(*h));
+	*count = 0;
+	for (size_t i = 0; i < h->sections; i++) {
+		if (table[i].type != type)
+			continue;
+		if (table[i].element_size != element_size) {
+			warning("snapshot: section %llu has elements of %llu bytes, expected %zu",
+					(unsigned long long)type, (unsigned long long)table[i].element_size, element_size);
+			return NULL;
+		}
+		*count = table[i].count;
+		return s->base + table[i].offset;
+	}
+	return NULL;
+}
+
+void snapshot_delete(snapshot_t *s) {
+	if (!s)
+		return;
+	free(s->pending);
+#ifndef _WIN32
+	if (s->mapped) {
+		munmap(s->base, s->size);
+		s->base = NULL;
+	}
+#endif
+	free(s->base);
+	free(s);
+}
@@ -0,0 +1,51 @@
+/** @file       snapshot.h
+ *  @brief      A versioned binary file of sections that can be mapped in
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct snapshot_t;
+typedef struct snapshot_t snapshot_t;
+
+/** Create a snapshot for writing, sections are added to it and then it is
+ * written out in one go with 'snapshot_write'. */
+snapshot_t *snapshot_new(void);
+
+/** Add a section of 'count' elements of 'element_size' bytes, the element
+ * size must be a multiple of eight and the elements must only contain 64-bit
+ * words (uint64_t or double) so they can be used in place when read. The data
+ * is not copied and must stay valid until the snapshot is written. */
+int snapshot_section_add(snapshot_t *s, uint64_t type, const void *data, size_t count, size_t element_size);
+
+/** Write to a temporary file which is synced and renamed over 'file' once
+ * complete */
+int snapshot_write(snapshot_t *s, const char *file);
+
+/** As 'snapshot_write' but the file is written on a background thread, the
+ * sections are copied before this returns so the snapshot and its data can
+ * be freed straight away. Only one write can be in progress, this returns
+ * negative without blocking if one is. 'snapshot_busy' checks for one and
+ * 'snapshot_wait' waits for it to complete, returning its result. */
+int snapshot_write_background(snapshot_t *s, const char *file);
+bool snapshot_busy(void);
+int snapshot_wait(void);
+
+/** Open a snapshot for reading, the file is mapped into memory where
+ * possible and the header, section table and checksum are validated */
+snapshot_t *snapshot_open(const char *file);
+
+/** Find a section by type, returning NULL if it is missing or if its element
+ * size differs from the one expected. The data is read only and is valid
+ * until the snapshot is closed. */
+const void *snapshot_section(const snapshot_t *s, uint64_t type, size_t element_size, size_t *count);
+
+void snapshot_delete(snapshot_t *s);
+
+#endif
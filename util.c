@@ -3,6 +3,9 @@
  *  @author     Richard Howe (2016)
  *  @license    MIT <https://opensource.org/licenses/MIT>
  *  @email      howe.r.j.89@gmail.com*/
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
 #include "util.h"
 #include <assert.h>
 #include <stdlib.h>
@@ -12,12 +15,16 @@
 #include <math.h>
 #include <time.h>
 
-typedef struct prng_t {
-	int method;
-	uint64_t seed[2];
-} prng_t;
+#ifdef __GNUC__
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL
+#endif
 
-static prng_t rstate;
+/* Each thread has its own PRNG state so threads can be given independent
+ * streams with 'random_seed_u64', the method is shared by all of them. */
+static int rmethod;
+static THREAD_LOCAL prng_t rstate;
 
 void fatal(char *fmt, ...) {
 	va_list args;
@@ -84,12 +91,12 @@ static uint32_t lcg64_temper(uint64_t *seed) {
 }
 
 void random_method(int method) {
-	rstate.method = method;
+	rmethod = method;
 }
 
 static uint32_t prng(prng_t *state) {
 	assert(state);
-	if (state->method)
+	if (rmethod)
 		return xorshift128(state->seed);
 	return lcg64_temper(&state->seed[0]);
 }
@@ -109,10 +116,34 @@ void random_seed(double seed) {
 	rstate.seed[0] = seed;
 }
 
+/* see <http://xoshiro.di.unimi.it/splitmix64.c>, used to spread a single
+ * seed value over the entire PRNG state. */
+static uint64_t splitmix64(uint64_t *x) {
+	assert(x);
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+void random_seed_u64(uint64_t seed) {
+	rstate.seed[0] = splitmix64(&seed);
+	rstate.seed[1] = splitmix64(&seed);
+}
+
+prng_t random_state(void) {
+	return rstate;
+}
+
+void random_state_set(const prng_t *state) {
+	assert(state);
+	rstate = *state;
+}
+
 /* Using fixed point instead of floats throughout would have
  * had the advantage of things being far more reproducible. */
 double random_float(void) {
-	static bool set = false;
+	static THREAD_LOCAL bool set = false;
 	if (!set) {
 		rstate.seed[0] = (rstate.seed[0] != 0.0) ? rstate.seed[0] : (uint64_t)time(NULL);
 		set = true;
@@ -120,6 +151,152 @@ double random_float(void) {
   	return prngf(&rstate);
 }
 
+/* Wall clock time in seconds from an arbitrary point, for reporting only */
+double wall_time(void) {
+#ifndef _WIN32
+	struct timespec t;
+	if (clock_gettime(CLOCK_MONOTONIC, &t) == 0)
+		return t.tv_sec + (t.tv_nsec / 1e9);
+#endif
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+/* A port of XXH64, see <https://github.com/Cyan4973/xxHash>, the input is
+ * read in native byte order so hashes are not portable between machines of
+ * differing endianess; snapshots, which hold some, are only read back on a
+ * machine of the same byte order. */
+static const uint64_t XXH_P1 = 11400714785074694791ull, XXH_P2 = 14029467366897019727ull,
+	XXH_P3 = 1609587929392839161ull, XXH_P4 = 9650029242287828579ull, XXH_P5 = 2870177450012600261ull;
+
+static uint64_t rotl64(uint64_t x, unsigned r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+	acc += input * XXH_P2;
+	return rotl64(acc, 31) * XXH_P1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, uint64_t v) {
+	acc ^= xxh64_round(0, v);
+	return acc * XXH_P1 + XXH_P4;
+}
+
+static uint64_t read64(const uint8_t *p) {
+	uint64_t r = 0;
+	memcpy(&r, p, sizeof(r));
+	return r;
+}
+
+uint64_t hash64(const void *data, size_t length, uint64_t seed) {
+	assert(data || !length);
+	const uint8_t *p = data, *const end = p + length;
+	uint64_t h = 0;
+	if (length >= 32) {
+		uint64_t v1 = seed + XXH_P1 + XXH_P2, v2 = seed + XXH_P2, v3 = seed, v4 = seed - XXH_P1;
+		for (; p + 32 <= end; p += 32) {
+			v1 = xxh64_round(v1, read64(p));
+			v2 = xxh64_round(v2, read64(p + 8));
+			v3 = xxh64_round(v3, read64(p + 16));
+			v4 = xxh64_round(v4, read64(p + 24));
+		}
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = xxh64_merge(h, v1);
+		h = xxh64_merge(h, v2);
+		h = xxh64_merge(h, v3);
+		h = xxh64_merge(h, v4);
+	} else {
+		h = seed + XXH_P5;
+	}
+	h += length;
+	for (; p + 8 <= end; p += 8) {
+		h ^= xxh64_round(0, read64(p));
+		h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+	}
+	if (p + 4 <= end) {
+		uint32_t k = 0;
+		memcpy(&k, p, sizeof(k));
+		h ^= k * XXH_P1;
+		h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * XXH_P5;
+		h = rotl64(h, 11) * XXH_P1;
+	}
+	h ^= h >> 33;
+	h *= XXH_P2;
+	h ^= h >> 29;
+	h *= XXH_P3;
+	h ^= h >> 32;
+	return h;
+}
+
+/* See "A Linear Algorithm For Generating Random Numbers With a Given
+ * Distribution" (Vose, 1991). The work array holds two stacks, one of
+ * under-full columns growing up and one of over-full columns growing down. */
+alias_t *alias_new(const double *weights, size_t count) {
+	assert(weights && count);
+	alias_t *a = allocate(sizeof(*a));
+	double *p  = allocate(sizeof(p[0]) * count);
+	size_t *work = allocate(sizeof(work[0]) * count);
+	a->count = count;
+	a->probability = p;
+	a->alias = allocate(sizeof(a->alias[0]) * count);
+	double total = 0;
+	for (size_t i = 0; i < count; i++)
+		total += MAX(0.0, weights[i]);
+	size_t small = 0, large = 0;
+	for (size_t i = 0; i < count; i++) {
+		p[i] = total > 0 ? (MAX(0.0, weights[i]) * count) / total : 1.0;
+		a->alias[i] = i;
+		if (p[i] < 1.0)
+			work[small++] = i;
+		else
+			work[count - ++large] = i;
+	}
+	while (small && large) {
+		const size_t s = work[--small], l = work[count - large--];
+		a->alias[s] = l;
+		p[l] = (p[l] + p[s]) - 1.0;
+		if (p[l] < 1.0)
+			work[small++] = l;
+		else
+			work[count - ++large] = l;
+	}
+	while (small) /* only rounding errors are left */
+		p[work[--small]] = 1.0;
+	while (large)
+		p[work[count - large--]] = 1.0;
+	free(work);
+	return a;
+}
+
+size_t alias_sample(const alias_t *a) {
+	assert(a);
+	const size_t i = random_u64() % a->count;
+	return random_float() < a->probability[i] ? i : a->alias[i];
+}
+
+void alias_delete(alias_t *a) {
+	if (!a)
+		return;
+	free(a->probability);
+	free(a->alias);
+	free(a);
+}
+
+size_t tournament_sample(const double *fitness, size_t count, size_t k) {
+	assert(fitness && count);
+	size_t best = random_u64() % count;
+	for (size_t i = 1; i < k; i++) {
+		const size_t j = random_u64() % count;
+		if (fitness[j] > fitness[best])
+			best = j;
+	}
+	return best;
+}
+
 /* https://stackoverflow.com/questions/11980292/how-to-wrap-around-a-range */
 double wrap_rad(double rad) {
 	rad = fmod(rad, 2.0 * PI);
@@ -36,15 +36,45 @@ typedef struct {
 	double y;
 } cartesian_t;
 
+/**@brief the state of the calling thread's PRNG, so a stream can be put
+ * aside and restored later */
+typedef struct {
+	uint64_t seed[2];
+} prng_t;
+
 void fatal(char *fmt, ...);
 void *allocate(size_t sz);
 char *duplicate(const char *s);
 double rad2deg(double rad);
 double deg2rad(double deg);
 void random_seed(double seed);
+void random_seed_u64(uint64_t seed);
 double random_float(void);
 uint64_t random_u64(void);
 void random_method(int m);
+prng_t random_state(void);
+void random_state_set(const prng_t *state);
+
+double wall_time(void);
+
+/**@brief a fast non-cryptographic hash (XXH64) */
+uint64_t hash64(const void *data, size_t length, uint64_t seed);
+
+/**@brief Walker's alias method; draws from a discrete distribution in O(1)
+ * after an O(N) set up, negative weights are treated as zero and if all
+ * weights are zero the distribution is uniform */
+typedef struct {
+	size_t count;
+	double *probability;
+	size_t *alias;
+} alias_t;
+
+alias_t *alias_new(const double *weights, size_t count);
+size_t alias_sample(const alias_t *a);
+void alias_delete(alias_t *a);
+
+/**@brief pick the fittest of 'k' entries drawn at random */
+size_t tournament_sample(const double *fitness, size_t count, size_t k);
 
 double wrap_rad(double rad);
 
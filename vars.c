@@ -5,6 +5,7 @@
  *  @email      howe.r.j.89@gmail.com */
 
 #include "vars.h"
+#include "util.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -126,12 +127,48 @@ static bool config_validate(void) {
 	return config_is_valid;
 }
 
+/* Item names are interned and looked up by address in a small open
+ * addressed table of their indices in 'db', built on first use */
+static struct {
+	const char **names;
+	size_t *items;
+	size_t mask, end;
+} item_index;
+
+static size_t item_slot(const char *name) {
+	return (size_t)(((uint64_t)(uintptr_t)name * 0x9E3779B97F4A7C15uLL) >> 32) & item_index.mask;
+}
+
+static void item_index_build(void) {
+	size_t size = 16;
+	for (item_index.end = 0; db[item_index.end].type != end_e; item_index.end++)
+		;
+	while (size < item_index.end * 2)
+		size *= 2;
+	item_index.names = allocate(sizeof(item_index.names[0]) * size);
+	item_index.items = allocate(sizeof(item_index.items[0]) * size);
+	item_index.mask  = size - 1;
+	for (size_t i = 0; i < item_index.end; i++) {
+		const char *name = intern(db[i].name, strlen(db[i].name));
+		size_t j = item_slot(name);
+		while (item_index.names[j])
+			j = (j + 1) & item_index.mask;
+		item_index.names[j] = name;
+		item_index.items[j] = i;
+	}
+}
+
 static size_t find_config_item(const char* item) {
-	size_t i;
-	for (i = 0; db[i].type != end_e; i++)
-		if (!strcmp(db[i].name, item))
-			break;
-	return i;
+	assert(item);
+	if (!item_index.names)
+		item_index_build();
+	const char *name = intern_find(item, strlen(item));
+	if (!name)
+		return item_index.end;
+	for (size_t i = item_slot(name); item_index.names[i]; i = (i + 1) & item_index.mask)
+		if (item_index.names[i] == name)
+			return item_index.items[i];
+	return item_index.end;
 }
 
 int config_load(void) {
@@ -300,3 +337,42 @@ fail:
 	return -1;
 }
 
+
+size_t config_items(void) {
+	size_t i;
+	for (i = 0; db[i].type != end_e; i++)
+		;
+	return i;
+}
+
+const char *config_item_name(size_t i) {
+	assert(i < config_items());
+	return db[i].name;
+}
+
+double config_item_get(size_t i) {
+	assert(i < config_items());
+	switch (db[i].type) {
+	case double_e:   return *(double*)db[i].addr;
+	case bool_e:     return *(bool*)db[i].addr;
+	case int_e:      return *(int*)db[i].addr;
+	case unsigned_e: return *(unsigned*)db[i].addr;
+	case end_e:      break;
+	default: error("invalid configuration item type '%d'", db[i].type);
+	}
+	return 0;
+}
+
+int config_item_set(const char *name, double value) {
+	assert(name);
+	const size_t i = find_config_item(name);
+	switch (db[i].type) {
+	case double_e:   *(double*)db[i].addr = value;     break;
+	case bool_e:     *(bool*)db[i].addr = value != 0;  break;
+	case int_e:      *(int*)db[i].addr = value;        break;
+	case unsigned_e: *(unsigned*)db[i].addr = value;   break;
+	case end_e:      warning("unknown configuration item '%s'", name); return -1;
+	default: error("invalid configuration item type '%d'", db[i].type);
+	}
+	return 0;
+}
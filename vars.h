@@ -28,14 +28,20 @@ typedef enum {
 
 #define CONFIG_X_MACRO\
 	X(bool,      world_save_at_exit,                 true,    ZERO,   EINS, "Attempt to save the world state at exit")\
+	X(unsigned,  world_checkpoint_generations,       0,       ZERO,   BIGS, "Write a checkpoint of the world in the background every this many generations (0 = off)")\
+	X(double,    world_checkpoint_seconds,           0.0,     ZERO,   BIGS, "Write a checkpoint of the world in the background at the end of a generation if this many seconds have passed since the last one (0 = off)")\
 	X(bool,      world_load_at_start,                true,    ZERO,   EINS, "Attempt to load the world state at startup")\
 	X(unsigned,  arena_food_count,                   4,       EINS,   BIGS, "The number of food objects in an arena at any given time")\
 	X(unsigned,  arena_gladiator_count,              2,       2.0,    BIGS, "The number of gladiators in an arena at in a match")\
-	X(unsigned,  arena_gladiator_rounds,             6,       EINS,   BIGS, "The number of gladiator rounds")\
+	X(unsigned,  arena_gladiator_rounds,             6,       EINS,   BIGS, "The population is 'arena_gladiator_count' times two to the power of this if 'arena_population' is zero, a knockout then has one more round than this as it is played down to a single final match; it is also the number of rounds in a Swiss tournament")\
+	X(unsigned,  arena_population,                   0,       ZERO,   BIGS, "Number of gladiators in the population, this can be any number no smaller than 'arena_gladiator_count' (0 = set by 'arena_gladiator_rounds')")\
+	X(unsigned,  arena_tournament_method,            0,       ZERO,   2.0,  "How matches are scheduled each generation (0 = knockout, 1 = Swiss, 2 = round robin)")\
 	X(unsigned,  arena_projectile_count,             50,      2.0,    BIGS, "Maximum number of projectiles available to be fired")\
 	X(bool,      arena_paused,                       false,   ZERO,   EINS, "Is the arena currently paused, used when displaying the arena and not in headless mode")\
 	X(bool,      arena_random_gladiator_start,       true,    ZERO,   EINS, "Is the starting position of each gladiator randomized, or do they start in a circle")\
 	X(double,    arena_tick_ms,                      15.0,    ZERO,   BIGS, "Tick speed in milliseconds when in GUI mode")\
+	X(double,    arena_stalemate_ticks,              0.0,     ZERO,   BIGS, "End a match early after this many ticks with no hits, no projectiles in flight and no gladiator moving further than 'arena_stalemate_distance' (0 = off)")\
+	X(double,    arena_stalemate_distance,           5.0,     ZERO,   BIGS, "Distance a gladiator must move within the stalemate window for the match to not be a stalemate")\
 	X(bool,      arena_wraps_at_edges,               false,   ZERO,   EINS, "Does the arena wrap at the edges (wrapping is experimental)")\
 	X(unsigned,  brain_activation_function,          0,       ZERO,   6.0,  "Activation function for the neurons (0 = logistic, 1 = tanh, 2 = atan, 3 = identity, 4 = step, 5 = rectifier, 6 = sin)")\
 	X(unsigned,  brain_input_normalization_method,   1,       ZERO,   2.0,  "Input normalization method to neural network (0 = 0 to 1, 1 = -1 to 1, 2 = -1 OR 1)")\
@@ -52,10 +58,12 @@ typedef enum {
 	X(double,    fitness_weight_ancestors,           0.0,     NEGT,   BIGS, "Fitness weight for this gladiators ancestors")\
 	X(double,    fitness_weight_energy,              0.0,     NEGT,   BIGS, "Fitness weight for energy that a gladiator has")\
 	X(double,    fitness_weight_food,                0.2,     NEGT,   BIGS, "Fitness weight for food objects that the gladiator has collected")\
+	X(double,    fitness_weight_hall_of_fame,        0.0,     NEGT,   BIGS, "Fitness weight for the mean score against opponents from the hall of fame")\
 	X(double,    fitness_weight_health,              1.5,     NEGT,   BIGS, "Fitness weight for remaining gladiator health")\
 	X(double,    fitness_weight_hits,                1.0,     NEGT,   BIGS, "Fitness weight for number of hits scored")\
 	X(double,    fitness_weight_fired,               0.00,    NEGT,   BIGS, "Fitness weight for firing a shot")\
 	X(double,    fitness_weight_round,               1.000,   NEGT,   BIGS, "Fitness weight for getting into a higher round")\
+	X(double,    fitness_weight_stalemate,           0.0,     NEGT,   BIGS, "Fitness weight for being in a match that ended in a stalemate")\
 	X(double,    fitness_weight_wall_time,           0.0,     NEGT,   BIGS, "Fitness weight for time spent hugging the wall in excess of the wall counter")\
 	X(double,    fitness_weight_time_alive,          0.000,   NEGT,   BIGS, "Fitness weight for time spent alive")\
 	X(bool,      food_active,                        false,   ZERO,   EINS, "Are the food objects active?")\
@@ -84,6 +92,8 @@ typedef enum {
 	X(double,    gladiator_vision,                   400.0,   SMOL,   BIGS, "Arc length for field of vision cone")\
 	X(double,    gladiator_wall_time,                5.0,     ZERO,   BIGS, "Number of ticks gladiator can spend stuck to a wall before its fitness is decremented")\
 	X(double,    max_ticks_per_generation,           10000.0, EINS,   BIGS, "Maximum number of ticks in a match between gladiators")\
+	X(double,    max_ticks_round_growth,             1.0,     EINS,   BIGS, "Each round of a knockout tournament gets this many times the tick budget of the round before it, the final round gets 'max_ticks_per_generation' (1 = every round gets the full budget)")\
+	X(double,    min_ticks_per_match,                100.0,   EINS,   BIGS, "Smallest tick budget given to a match in the early rounds of the tournament")\
 	X(double,    mutation_rate,                      0.175,   ZERO,   BIGS, "Rate of mutation (not used directly)")\
 	X(bool,      print_arena_tick,                   true,    ZERO,   EINS, "Print the current tick count")\
 	X(bool,      print_fps,                          true,    ZERO,   EINS, "Print the frame rate in Frames Per Second")\
@@ -116,12 +126,14 @@ typedef enum {
 	X(bool,      input_gladiator_collision_enemy,    false,   ZERO,   EINS, "Turn input 'collision with enemy' on")\
 	X(bool,      input_gladiator_collision_wall,     false,   ZERO,   EINS, "Turn input 'collision with wall' on")\
 	X(unsigned,  program_random_method,              0,       ZERO,   EINS, "Set the Pseudo Random Number Generator used (0 = lcg, 1 = xorshift)")\
+	X(unsigned,  program_breeding_threads,           0,       ZERO,   256,  "Number of threads used to build the next generation (0 = one per processor), the result does not depend on it")\
 	X(unsigned,  program_headless_loops,             30,      ZERO,   BIGS, "Number of loops to run the program without launching the GUI")\
 	X(unsigned,  program_log_level,                  NOTE,    ZERO,   5.0,  "Set the program log level")\
 	X(bool,      program_pause_after_new_generation, false,   ZERO,   EINS, "In GUI mode, pause after a generation has been completed")\
 	X(double,    program_random_seed,                7.0,     ZERO,   BIGS, "The program uses a PRNG that is seeded with this value")\
 	X(bool,      program_run_headless,               true,    ZERO,   EINS, "Start the program up in headless mode, which executes much faster")\
 	X(bool,      program_run_window_after_headless,  true,    ZERO,   EINS, "After running the program in headless mode, launch the GUI mode so you can see the results")\
+	X(unsigned,  program_worker_processes,           0,       ZERO,   1024, "Number of worker processes used to evaluate matches in headless mode (0 = evaluate matches in this process)")\
 	X(double,    projectile_damage,                  1.0,     NEGT,   BIGS, "Damage done by each projectile")\
 	X(double,    projectile_distance_per_tick,       1.5,     NEGT,   BIGS, "Distance travelled by a projectile per tick")\
 	X(double,    projectile_energy_cost,             50.0,    NEGT,   BIGS, "Energy cost required to fire a projectile")\
@@ -140,6 +152,16 @@ typedef enum {
 	X(double,    breeding_rate,                      0.9,     ZERO,   EINS, "Amount of gladiators of breeding compared to copying (both with mutations)")\
 	X(double,    breeding_crossover_rate,            0.5,     ZERO,   EINS, "Crossover point/rate")\
 	X(unsigned,  breeding_crossover_method,          1,       ZERO,   3.0,  "Breeding crossover method (0 = off, 1 = cross-over layers, 2 = swap neurons within layer, 3 = random neuron swap)")\
+	X(unsigned,  evolution_method,                   0,       ZERO,   2.0,  "Evolution method (0 = generational tournament, 1 = steady state; losers are replaced as soon as their match ends, headless mode only, 2 = evolution strategy; the tournament scores mirrored perturbations of one genome)")\
+	X(double,    evolution_strategy_sigma,           0.5,     SMOL,   BIGS, "Standard deviation of the noise added to the genome by the evolution strategy")\
+	X(double,    evolution_strategy_learning_rate,   1.0,     ZERO,   BIGS, "Step size of the evolution strategy")\
+	X(unsigned,  selection_method,                   0,       ZERO,   1.0,  "Parent selection method (0 = fitness proportional roulette wheel, 1 = tournament of 'selection_tournament_size')")\
+	X(unsigned,  evaluation_cache_entries,           0,       ZERO,   BIGS, "Entries in the cache of match results, repeated matches between the same genomes are not run again (0 = off, worker processes only)")\
+	X(unsigned,  hall_of_fame_size,                  0,       ZERO,   BIGS, "Number of past champions kept to benchmark each generation against (0 = off, headless mode only)")\
+	X(unsigned,  hall_of_fame_opponents,             4,       EINS,   64.0, "Number of champions drawn from the hall of fame to play each gladiator against")\
+	X(bool,      lineage_archive_on,                 false,   ZERO,   EINS, "Append every new gladiator and its parents to the lineage archive 'gladiator.lin'")\
+	X(unsigned,  lineage_keyframe_interval,          16,      ZERO,   BIGS, "Maximum number of deltas in the lineage archive before a full copy of a genome is stored")\
+	X(unsigned,  selection_tournament_size,          3,       EINS,   BIGS, "Number of gladiators drawn for each tournament selection of a parent")\
 	X(double,    window_height,                      400.0,   EINS,   BIGS, "GUI Window Height")\
 	X(double,    window_width,                       400.0,   EINS,   BIGS, "GUI Window Width")\
 	X(double,    window_x_starting_position,         60.0,    ZERO,   BIGS, "GUI Window x-position on screen at startup")\
@@ -168,6 +190,12 @@ void debug(const char *fmt, ...);
 cell_t *config_serialize(void);
 int config_deserialize(cell_t *c);
 
+/* Items in the order of the configuration table, values are widened to a double */
+size_t config_items(void);
+const char *config_item_name(size_t i);
+double config_item_get(size_t i);
+int config_item_set(const char *name, double value);
+
 extern const char *default_config_file;
 
 #endif
@@ -0,0 +1,429 @@
+/** @file       worker.c
+ *  @brief      Multi-process match evaluation over shared memory
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com
+ *
+ * A coordinator (the process that creates the pool) places genomes and the
+ * state of each match member into an anonymous shared memory mapping and
+ * posts a batch
+ * of matches, a number of forked worker processes then claim and run those
+ * matches and write the results back into the same mapping. Matches are
+ * claimed with atomic operations on a ticket counter and on the state of
+ * each match slot, no locks are used. If a worker dies whilst running a
+ * match the coordinator puts that match back into the queue and forks a
+ * replacement worker.
+ *
+ * The atomics used are the GCC/Clang '__atomic' built-ins, this is not
+ * C99 but is widely supported. */
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "worker.h"
+#include "util.h"
+#include "vars.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define WORKER_ALIGN        (64u)
+#define WORKER_MAX_RETRIES  (3u)
+
+enum {
+	MATCH_FREE,
+	MATCH_PENDING,
+	MATCH_DONE,
+	MATCH_RUNNING, /**< MATCH_RUNNING + worker index when a match is claimed */
+};
+
+typedef struct {
+	uint32_t state;
+	uint32_t count;
+	uint64_t seed;
+	uint64_t limit;  /**< a limit the worker should run the match to, such as a tick budget */
+	uint64_t result; /**< a value the worker can pass back, such as ticks run */
+} match_slot_t;
+
+typedef struct {
+	uint32_t stop;    /**< set to tell all workers to exit */
+	uint32_t matches; /**< matches in current batch, zero if none posted */
+	uint32_t cursor;  /**< next match ticket to hand out */
+} shared_t;
+
+struct worker_pool_t {
+	size_t workers, genomes, genome_length, state_length, matches, members;
+	worker_match_cb cb;
+	void *param;
+	pid_t parent;
+	pid_t *pids;
+	unsigned *retries;
+	size_t size;
+	unsigned char *map;
+	shared_t *shared;
+	match_slot_t *slots;
+	size_t *member;
+	double *genome, *state;
+};
+
+static size_t align(size_t sz) {
+	return (sz + (WORKER_ALIGN - 1)) & ~(size_t)(WORKER_ALIGN - 1);
+}
+
+static void nap(void) {
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = 50000 };
+	nanosleep(&ts, NULL);
+}
+
+static bool claim(match_slot_t *s, unsigned id) {
+	uint32_t expected = MATCH_PENDING;
+	return __atomic_compare_exchange_n(&s->state, &expected, MATCH_RUNNING + id, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+static void run(worker_pool_t *p, size_t match) {
+	if (p->cb(p->param, p, match) < 0)
+		warning("worker match %zu failed", match);
+	__atomic_store_n(&p->slots[match].state, MATCH_DONE, __ATOMIC_RELEASE);
+}
+
+static void worker_main(worker_pool_t *p, unsigned id) {
+	assert(p);
+	shared_t *s = p->shared;
+	for (;;) {
+		if (__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE) || getppid() != p->parent)
+			_exit(0);
+		const uint32_t n = __atomic_load_n(&s->matches, __ATOMIC_ACQUIRE);
+		bool ran = false;
+		if (n) {
+			const uint32_t m = __atomic_fetch_add(&s->cursor, 1, __ATOMIC_ACQ_REL);
+			if (m < n) {
+				if (claim(&p->slots[m], id)) {
+					run(p, m);
+					ran = true;
+				}
+			} else { /* queue drained, pick up any reassigned matches */
+				for (uint32_t i = 0; i < n; i++) {
+					if (claim(&p->slots[i], id)) {
+						run(p, i);
+						ran = true;
+					}
+				}
+			}
+		}
+		if (!ran)
+			nap();
+	}
+}
+
+static int spawn(worker_pool_t *p, unsigned id) {
+	assert(p);
+	fflush(NULL);
+	const pid_t pid = fork();
+	if (pid < 0) {
+		warning("fork failed: %s", strerror(errno));
+		return -1;
+	}
+	if (pid == 0)
+		worker_main(p, id);
+	p->pids[id] = pid;
+	return 0;
+}
+
+worker_pool_t *worker_pool_new(size_t workers, size_t genomes, size_t genome_length, size_t state_length, size_t matches, size_t members, worker_match_cb cb, void *param) {
+	assert(cb);
+	if (!workers || !genomes || !matches || !members)
+		return NULL;
+	worker_pool_t *p = allocate(sizeof(*p));
+	p->workers       = workers;
+	p->genomes       = genomes;
+	p->genome_length = genome_length;
+	p->state_length  = state_length;
+	p->matches       = matches;
+	p->members       = members;
+	p->cb            = cb;
+	p->param         = param;
+	p->parent        = getpid();
+	p->pids          = allocate(sizeof(p->pids[0]) * workers);
+	p->retries       = allocate(sizeof(p->retries[0]) * matches);
+
+	const size_t o_slots  = align(sizeof(shared_t));
+	const size_t o_member = o_slots  + align(sizeof(match_slot_t) * matches);
+	const size_t o_genome = o_member + align(sizeof(size_t) * matches * members);
+	const size_t o_state  = o_genome + align(sizeof(double) * genomes * genome_length);
+	p->size = o_state + align(sizeof(double) * matches * members * state_length);
+	void *map = mmap(NULL, p->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		warning("worker shared memory mapping of %zu bytes failed: %s", p->size, strerror(errno));
+		free(p->retries);
+		free(p->pids);
+		free(p);
+		return NULL;
+	}
+	p->map    = map;
+	p->shared = map;
+	p->slots  = (match_slot_t*)(p->map + o_slots);
+	p->member = (size_t*)(p->map + o_member);
+	p->genome = (double*)(p->map + o_genome);
+	p->state  = (double*)(p->map + o_state);
+
+	for (size_t i = 0; i < workers; i++) {
+		if (spawn(p, i) < 0) {
+			p->workers = i;
+			worker_pool_delete(p);
+			return NULL;
+		}
+	}
+	return p;
+}
+
+void worker_pool_delete(worker_pool_t *p) {
+	if (!p)
+		return;
+	__atomic_store_n(&p->shared->stop, 1, __ATOMIC_RELEASE);
+	for (size_t i = 0; i < p->workers; i++)
+		if (p->pids[i] > 0)
+			waitpid(p->pids[i], NULL, 0);
+	munmap(p->map, p->size);
+	free(p->retries);
+	free(p->pids);
+	free(p);
+}
+
+size_t worker_pool_workers(worker_pool_t *p) {
+	assert(p);
+	return p->workers;
+}
+
+size_t worker_pool_genomes(worker_pool_t *p) {
+	assert(p);
+	return p->genomes;
+}
+
+size_t worker_pool_matches(worker_pool_t *p) {
+	assert(p);
+	return p->matches;
+}
+
+double *worker_genome(worker_pool_t *p, size_t genome) {
+	assert(p && genome < p->genomes);
+	return &p->genome[genome * p->genome_length];
+}
+
+double *worker_state(worker_pool_t *p, size_t match, size_t member) {
+	assert(p && match < p->matches && member < p->members);
+	return &p->state[((match * p->members) + member) * p->state_length];
+}
+
+void worker_match_set(worker_pool_t *p, size_t match, const size_t *members, size_t count, uint64_t seed, uint64_t limit) {
+	assert(p && members);
+	assert(match < p->matches && count <= p->members);
+	match_slot_t *s = &p->slots[match];
+	__atomic_store_n(&s->state, MATCH_FREE, __ATOMIC_RELEASE);
+	for (size_t i = 0; i < count; i++) {
+		assert(members[i] < p->genomes);
+		p->member[(match * p->members) + i] = members[i];
+	}
+	s->count = count;
+	s->seed = seed;
+	s->limit = limit;
+	s->result = 0;
+}
+
+size_t worker_match_members(worker_pool_t *p, size_t match, const size_t **members) {
+	assert(p && members && match < p->matches);
+	*members = &p->member[match * p->members];
+	return p->slots[match].count;
+}
+
+uint64_t worker_match_seed(worker_pool_t *p, size_t match) {
+	assert(p && match < p->matches);
+	return p->slots[match].seed;
+}
+
+uint64_t worker_match_limit(worker_pool_t *p, size_t match) {
+	assert(p && match < p->matches);
+	return p->slots[match].limit;
+}
+
+void worker_match_result_set(worker_pool_t *p, size_t match, uint64_t result) {
+	assert(p && match < p->matches);
+	p->slots[match].result = result;
+}
+
+uint64_t worker_match_result(worker_pool_t *p, size_t match) {
+	assert(p && match < p->matches);
+	return p->slots[match].result;
+}
+
+/* Any match held by a worker that has died is put back into the queue, and
+ * the worker is replaced, a match that keeps killing workers is fatal. Only
+ * this pool's own workers are waited for, there may be other pools whose
+ * dead workers are theirs to reap. */
+static int reap(worker_pool_t *p, size_t matches) {
+	assert(p);
+	for (size_t id = 0; id < p->workers; id++) {
+		int status = 0;
+		const pid_t pid = p->pids[id];
+		if (pid <= 0 || waitpid(pid, &status, WNOHANG) != pid)
+			continue;
+		warning("worker %zu (pid %ld) exited unexpectedly, reassigning its matches", id, (long)pid);
+		p->pids[id] = -1;
+		for (size_t i = 0; i < matches; i++) {
+			uint32_t expected = MATCH_RUNNING + id;
+			if (__atomic_compare_exchange_n(&p->slots[i].state, &expected, MATCH_PENDING, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+				if (++p->retries[i] > WORKER_MAX_RETRIES)
+					fatal("match %zu failed on %u workers", i, WORKER_MAX_RETRIES);
+		}
+		if (spawn(p, id) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+int worker_pool_post(worker_pool_t *p, size_t matches) {
+	assert(p && matches <= p->matches);
+	shared_t *s = p->shared;
+	memset(p->retries, 0, sizeof(p->retries[0]) * p->matches);
+	for (size_t i = 0; i < matches; i++)
+		__atomic_store_n(&p->slots[i].state, MATCH_PENDING, __ATOMIC_RELEASE);
+	__atomic_store_n(&s->cursor, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&s->matches, matches, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int worker_pool_wait(worker_pool_t *p, size_t matches, worker_done_cb done, void *param) {
+	assert(p && matches <= p->matches);
+	shared_t *s = p->shared;
+	bool *seen = allocate(sizeof(seen[0]) * (matches ? matches : 1));
+	int r = 0;
+	for (size_t finished = 0; finished < matches;) {
+		bool progress = false;
+		for (size_t i = 0; i < matches; i++) {
+			if (seen[i] || __atomic_load_n(&p->slots[i].state, __ATOMIC_ACQUIRE) != MATCH_DONE)
+				continue;
+			seen[i] = true;
+			finished++;
+			progress = true;
+			if (done && done(param, p, i) < 0)
+				r = -1;
+		}
+		if (progress)
+			continue;
+		if (reap(p, matches) < 0) {
+			r = -1;
+			break;
+		}
+		nap();
+	}
+	__atomic_store_n(&s->matches, 0, __ATOMIC_RELEASE);
+	free(seen);
+	return r;
+}
+
+/* In continuous mode every slot is open to the workers at once and matches
+ * are posted and collected one at a time, the ticket counter is left past the
+ * end of the slots so that the workers scan for pending matches instead. */
+int worker_pool_start(worker_pool_t *p) {
+	assert(p);
+	shared_t *s = p->shared;
+	memset(p->retries, 0, sizeof(p->retries[0]) * p->matches);
+	for (size_t i = 0; i < p->matches; i++)
+		__atomic_store_n(&p->slots[i].state, MATCH_FREE, __ATOMIC_RELEASE);
+	__atomic_store_n(&s->cursor, p->matches, __ATOMIC_RELEASE);
+	__atomic_store_n(&s->matches, p->matches, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int worker_match_post(worker_pool_t *p, size_t match) {
+	assert(p && match < p->matches);
+	p->retries[match] = 0;
+	__atomic_store_n(&p->slots[match].state, MATCH_PENDING, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Blocks until at least one posted match is complete, the callback is run
+ * for each complete match and the slot is freed before the callback is
+ * called, so it may set and post the slot again. */
+int worker_pool_poll(worker_pool_t *p, worker_done_cb done, void *param) {
+	assert(p);
+	for (;;) {
+		int r = 0;
+		bool progress = false;
+		for (size_t i = 0; i < p->matches; i++) {
+			uint32_t expected = MATCH_DONE;
+			if (!__atomic_compare_exchange_n(&p->slots[i].state, &expected, MATCH_FREE, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+				continue;
+			progress = true;
+			if (done && done(param, p, i) < 0)
+				r = -1;
+		}
+		if (progress)
+			return r;
+		if (reap(p, p->matches) < 0)
+			return -1;
+		nap();
+	}
+}
+
+void worker_pool_stop(worker_pool_t *p) {
+	assert(p);
+	__atomic_store_n(&p->shared->matches, 0, __ATOMIC_RELEASE);
+}
+
+int worker_pool_run(worker_pool_t *p, size_t matches) {
+	if (worker_pool_post(p, matches) < 0)
+		return -1;
+	return worker_pool_wait(p, matches, NULL, NULL);
+}
+
+#else /* Windows has no fork(2), matches are run in process instead */
+
+worker_pool_t *worker_pool_new(size_t workers, size_t genomes, size_t genome_length, size_t state_length, size_t matches, size_t members, worker_match_cb cb, void *param) {
+	UNUSED(workers); UNUSED(genomes); UNUSED(genome_length); UNUSED(state_length);
+	UNUSED(matches); UNUSED(members); UNUSED(cb); UNUSED(param);
+	warning("worker processes are not supported on this platform");
+	return NULL;
+}
+
+void worker_pool_delete(worker_pool_t *p) { UNUSED(p); }
+int worker_pool_post(worker_pool_t *p, size_t matches) { UNUSED(p); UNUSED(matches); return -1; }
+int worker_pool_wait(worker_pool_t *p, size_t matches, worker_done_cb done, void *param) {
+	UNUSED(p); UNUSED(matches); UNUSED(done); UNUSED(param);
+	return -1;
+}
+int worker_pool_run(worker_pool_t *p, size_t matches) { UNUSED(p); UNUSED(matches); return -1; }
+int worker_pool_start(worker_pool_t *p) { UNUSED(p); return -1; }
+int worker_match_post(worker_pool_t *p, size_t match) { UNUSED(p); UNUSED(match); return -1; }
+int worker_pool_poll(worker_pool_t *p, worker_done_cb done, void *param) { UNUSED(p); UNUSED(done); UNUSED(param); return -1; }
+void worker_pool_stop(worker_pool_t *p) { UNUSED(p); }
+size_t worker_pool_workers(worker_pool_t *p) { UNUSED(p); return 0; }
+size_t worker_pool_genomes(worker_pool_t *p) { UNUSED(p); return 0; }
+size_t worker_pool_matches(worker_pool_t *p) { UNUSED(p); return 0; }
+double *worker_genome(worker_pool_t *p, size_t genome) { UNUSED(p); UNUSED(genome); return NULL; }
+double *worker_state(worker_pool_t *p, size_t match, size_t member) { UNUSED(p); UNUSED(match); UNUSED(member); return NULL; }
+void worker_match_set(worker_pool_t *p, size_t match, const size_t *members, size_t count, uint64_t seed, uint64_t limit) {
+	UNUSED(p); UNUSED(match); UNUSED(members); UNUSED(count); UNUSED(seed); UNUSED(limit);
+}
+size_t worker_match_members(worker_pool_t *p, size_t match, const size_t **members) {
+	UNUSED(p); UNUSED(match); UNUSED(members);
+	return 0;
+}
+uint64_t worker_match_seed(worker_pool_t *p, size_t match) { UNUSED(p); UNUSED(match); return 0; }
+uint64_t worker_match_limit(worker_pool_t *p, size_t match) { UNUSED(p); UNUSED(match); return 0; }
+void worker_match_result_set(worker_pool_t *p, size_t match, uint64_t result) { UNUSED(p); UNUSED(match); UNUSED(result); }
+uint64_t worker_match_result(worker_pool_t *p, size_t match) { UNUSED(p); UNUSED(match); return 0; }
+
+#endif
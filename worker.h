@@ -0,0 +1,49 @@
+/** @file       worker.h
+ *  @brief      Multi-process match evaluation over shared memory
+ *  @author     Richard Howe (2016)
+ *  @license    MIT <https://opensource.org/licenses/MIT>
+ *  @email      howe.r.j.89@gmail.com*/
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct worker_pool_t;
+typedef struct worker_pool_t worker_pool_t;
+
+/** Called within a worker process to run a single match, the match members
+ * index into the genome pool and the result table, the callback should read
+ * the genomes and state for each member and write the results back. */
+typedef int (*worker_match_cb)(void *param, worker_pool_t *p, size_t match);
+
+/** Called within the coordinator once for each match in a batch as soon as
+ * it has been seen to complete. */
+typedef int (*worker_done_cb)(void *param, worker_pool_t *p, size_t match);
+
+worker_pool_t *worker_pool_new(size_t workers, size_t genomes, size_t genome_length, size_t state_length, size_t matches, size_t members, worker_match_cb cb, void *param);
+void worker_pool_delete(worker_pool_t *p);
+int worker_pool_post(worker_pool_t *p, size_t matches);
+int worker_pool_wait(worker_pool_t *p, size_t matches, worker_done_cb done, void *param);
+int worker_pool_run(worker_pool_t *p, size_t matches);
+size_t worker_pool_workers(worker_pool_t *p);
+size_t worker_pool_genomes(worker_pool_t *p);
+size_t worker_pool_matches(worker_pool_t *p);
+
+/* Continuous mode; matches are posted and collected individually */
+int worker_pool_start(worker_pool_t *p);
+int worker_match_post(worker_pool_t *p, size_t match);
+int worker_pool_poll(worker_pool_t *p, worker_done_cb done, void *param);
+void worker_pool_stop(worker_pool_t *p);
+
+double *worker_genome(worker_pool_t *p, size_t genome);
+double *worker_state(worker_pool_t *p, size_t match, size_t member);
+void worker_match_set(worker_pool_t *p, size_t match, const size_t *members, size_t count, uint64_t seed, uint64_t limit);
+size_t worker_match_members(worker_pool_t *p, size_t match, const size_t **members);
+uint64_t worker_match_seed(worker_pool_t *p, size_t match);
+uint64_t worker_match_limit(worker_pool_t *p, size_t match);
+void worker_match_result_set(worker_pool_t *p, size_t match, uint64_t result);
+uint64_t worker_match_result(worker_pool_t *p, size_t match);
+
+#endif